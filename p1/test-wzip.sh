@@ -0,0 +1,10 @@
+#! /bin/bash
+
+if ! [[ -x wzip && -x wunzip ]]; then
+    echo "wzip or wunzip executable does not exist"
+    exit 1
+fi
+
+../tester/run-tests.sh $*
+
+
@@ -7,6 +7,12 @@
 #define InitCharPos 4
 #define FlushBuffer() fwrite(outbuf, sizeof(char), outcur - outbuf, stdout); \
 			outcur = outbuf
+/* pzip --format=varint streams open with a zero-count record holding 'V' */
+#define VarintFormat 'V'
+#define VarintMaxBytes 10
+
+unsigned char* UnzipVarint(FILE* fp, unsigned char* outbuf, 
+							unsigned char* outcur, size_t buffersize);
 
 int main(int argc, char* argv[])
 {
@@ -36,6 +42,7 @@ int main(int argc, char* argv[])
 	/* Index of the character symbol mod 5. Initially set to position 4. */
 	unsigned short charOffset = InitCharPos;
 	FILE* fp;
+	unsigned char header[WordSize];
 
 	while (--argc > 0)
 	{
@@ -45,6 +52,16 @@ int main(int argc, char* argv[])
 			printf("error:wunzip.c: unable to open file\n");
 			exit(1);
 		}
+		if (fread(header, sizeof(char), WordSize, fp) == WordSize
+			&& header[0] == 0 && header[1] == 0 && header[2] == 0 
+			&& header[3] == 0 && header[4] == VarintFormat)
+		{
+			outcur = UnzipVarint(fp, outbuf, outcur, buffersize);
+			FlushBuffer();
+			fclose(fp);
+			continue;
+		}
+		rewind(fp);
 		count = 0;
 		charOffset = InitCharPos;
 		while ((len = fread(buffer, sizeof(char), buffersize, fp)) > 0)
@@ -81,3 +98,60 @@ int main(int argc, char* argv[])
 	free(buffer);
 	free(outbuf);
 }
+
+/*
+ * Decode the tokens of a varint stream: a LEB128 value n, then one byte
+ * repeated n / 2 times if n is even, or n / 2 literal bytes if it is odd.
+ * Returns the new end of the data in outbuf.
+ */
+unsigned char* UnzipVarint(FILE* fp, unsigned char* outbuf, 
+							unsigned char* outcur, size_t buffersize)
+{
+	uint64_t n;
+	uint64_t count;
+	int c;
+	int shift;
+
+	while ((c = getc(fp)) != EOF)
+	{
+		n = 0;
+		shift = 0;
+		while (c & 0x80)
+		{
+			n |= (uint64_t) (c & 0x7f) << shift;
+			shift += 7;
+			if ((c = getc(fp)) == EOF || shift >= 7 * VarintMaxBytes)
+			{
+				printf("error:wunzip.c: truncated varint stream\n");
+				exit(1);
+			}
+		}
+		n |= (uint64_t) c << shift;
+
+		// a run carries its byte even when its count is 0
+		if ((n & 1) == 0 && (c = getc(fp)) == EOF)
+		{
+			printf("error:wunzip.c: truncated varint stream\n");
+			exit(1);
+		}
+		for (count = n >> 1; count > 0; count--)
+		{
+			if (n & 1)
+			{
+				c = getc(fp);
+			}
+			if (c == EOF)
+			{
+				printf("error:wunzip.c: truncated varint stream\n");
+				exit(1);
+			}
+			*outcur++ = c;
+			if (outcur >= outbuf + buffersize)
+			{
+				FlushBuffer();
+			}
+		}
+	}
+
+	return outcur;
+}
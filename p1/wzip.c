@@ -38,14 +38,14 @@ int main(int argc, char* argv[])
 		printf("wzip: cannot allocate buffer space\n");
 		exit(1);
 	}
-	size_t idx;
+	size_t idx = 0;
 	rle_t* outbuffer = (rle_t*)malloc(sizeof(rle_t) * RunLengthBufferSize);
 	if (outbuffer == NULL)
 	{
 		printf("wzip: cannot allocate buffer space\n");
 		exit(1);
 	}
-	byte_t curchar;
+	byte_t curchar = 0;
 	uint32_t counter = 0;
 	ssize_t len;
 
@@ -64,8 +64,12 @@ int main(int argc, char* argv[])
 			tail = inbuffer + len;
 			
 			// if leftover from previous iteration needs to be copied
-			if (counter && *cur != curchar)
+			if (counter && (byte_t) *cur != curchar)
 			{
+				if (idx >= RunLengthBufferSize)
+				{
+					flushBuffer();
+				}
 				cpyToBuf(counter, curchar);
 				counter = 0;
 			}
@@ -108,6 +112,10 @@ int main(int argc, char* argv[])
 
 	if (counter)
 	{
+		if (idx >= RunLengthBufferSize)
+		{
+			flushBuffer();
+		}
 		cpyToBuf(counter, curchar);
 		flushBuffer();
 	}
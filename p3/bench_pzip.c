@@ -0,0 +1,527 @@
+/*
+ * End-to-end benchmark of pzip over generated corpora: random bytes, long
+ * runs, text logs and sparse images from 1 MB up to --max-size (at most
+ * 10 GB). Each corpus is compressed at several thread counts and chunk
+ * sizes, and by single-threaded wzip from p1, recording MB/s, peak RSS
+ * and CPU utilisation, and each pzip run's speed relative to wzip's. Exits
+ * 1 if a pzip run is more than --threshold percent slower than the same
+ * run in the saved baseline.
+ *
+ * bench_pzip [--dir D] [--max-size N] [--threshold PCT] [--save]
+ *            [--pzip PATH] [--wzip PATH]
+ *
+ * Corpora are kept in D between runs; --save writes the results to
+ * D/baseline for later runs on the same machine to be held against.
+ */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "stats.h"
+#include "utilities.h"
+
+#define szGenBuffer (1 << 20)
+/*
+ * runs per configuration, the fastest being kept; quick runs repeat until
+ * nsMinMeasure has passed, so start-up noise does not pass for a regression
+ */
+#define nRepeats (3)
+#define MaxRepeats (100)
+#define nsMinMeasure (1000000000ULL)
+#define MaxResults (1024)
+#define MaxThreadCounts (16)
+#define BaselineName "baseline"
+
+typedef struct __corpus_t
+{
+	char* szKind;
+	void (*fnFill)(unsigned char* pBuffer, size_t szBuffer);
+} corpus_t;
+
+typedef struct __result_t
+{
+	char szKey[96];
+	double rate;
+} result_t;
+
+char* mszDir = "/tmp/pzip-bench";
+size_t mszMax = 64 << 20;
+double mThreshold = 10;
+int mSave = 0;
+char* mszPzip = "./pzip";
+char* mszWzip = "../p1/wzip";
+
+uint64_t mRandom = 0x9e3779b97f4a7c15;
+
+result_t mpResults[MaxResults];
+int mnResults = 0;
+int mnRegressions = 0;
+
+void ParseArgs(int argc, char** argv);
+size_t ParseSize(char* szValue);
+char* FormatSize(char* szOut, size_t size);
+uint64_t Random();
+void FillRandom(unsigned char* pBuffer, size_t szBuffer);
+void FillRuns(unsigned char* pBuffer, size_t szBuffer);
+void FillText(unsigned char* pBuffer, size_t szBuffer);
+void Generate(char* szPath, corpus_t* pCorpus, size_t size);
+void BenchCorpus(char* szPath, char* szName, size_t size);
+double Measure(char* szKey, char** argv, size_t size, double wzip);
+uint64_t Run(char** argv, struct rusage* pUsage);
+void CheckBaseline();
+
+corpus_t mpCorpora[] = {
+	{ "random", FillRandom },
+	{ "runs", FillRuns },
+	{ "text", FillText },
+	/* holes with a little text every 1/16th of the file */
+	{ "sparse", NULL },
+};
+size_t mpSizes[] = { 1 << 20, 64 << 20, 1 << 30, 10ULL << 30 };
+
+int main(int argc, char** argv)
+{
+	char szPath[256];
+	char szName[64];
+	char szSize[16];
+
+	ParseArgs(argc, argv);
+	mkdir(mszDir, 0755);
+
+	printf("%-14s %-5s %3s %6s %10s %7s %9s %6s\n", "corpus", "prog", "j",
+			"chunk", "MB/s", "x wzip", "RSS MB", "CPU %");
+	for (int i = 0; i < sizeof(mpSizes) / sizeof(size_t); i++)
+	{
+		if (mpSizes[i] > mszMax)
+		{
+			break;
+		}
+		for (int j = 0; j < sizeof(mpCorpora) / sizeof(corpus_t); j++)
+		{
+			snprintf(szName, sizeof(szName), "%s-%s", mpCorpora[j].szKind,
+						FormatSize(szSize, mpSizes[i]));
+			snprintf(szPath, sizeof(szPath), "%s/%s", mszDir, szName);
+			Generate(szPath, &mpCorpora[j], mpSizes[i]);
+			BenchCorpus(szPath, szName, mpSizes[i]);
+		}
+	}
+
+	CheckBaseline();
+	if (mnRegressions > 0)
+	{
+		printf("%d regression(s) beyond %.0f%%\n", mnRegressions,
+				mThreshold);
+		return 1;
+	}
+
+	return 0;
+}
+
+void ParseArgs(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--save") == 0)
+		{
+			mSave = 1;
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--dir") == 0)
+		{
+			mszDir = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--max-size") == 0)
+		{
+			mszMax = ParseSize(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--threshold") == 0)
+		{
+			mThreshold = atof(argv[++i]);
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--pzip") == 0)
+		{
+			mszPzip = argv[++i];
+		}
+		else if (i + 1 < argc && strcmp(argv[i], "--wzip") == 0)
+		{
+			mszWzip = argv[++i];
+		}
+		else
+		{
+			printf("bench_pzip: [--dir D] [--max-size N] [--threshold PCT] "
+					"[--save] [--pzip PATH] [--wzip PATH]\n");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Parse a byte count with an optional K, M or G suffix.
+ */
+size_t ParseSize(char* szValue)
+{
+	char* pEnd;
+	size_t n = strtoull(szValue, &pEnd, 10);
+
+	switch (*pEnd)
+	{
+		case 'g': case 'G': n <<= 10; // fall through
+		case 'm': case 'M': n <<= 10; // fall through
+		case 'k': case 'K': n <<= 10; pEnd++; // fall through
+		default: break;
+	}
+	if (pEnd == szValue || *pEnd != '\0')
+	{
+		printf("bench_pzip: invalid size '%s'\n", szValue);
+		exit(1);
+	}
+
+	return n;
+}
+
+/* size as a whole number of the largest unit that divides it */
+char* FormatSize(char* szOut, size_t size)
+{
+	char* szUnits = "BKMG";
+	int nUnit = 0;
+
+	while (nUnit < 3 && size >= 1024 && size % 1024 == 0)
+	{
+		size /= 1024;
+		nUnit++;
+	}
+	sprintf(szOut, "%zu%c", size, szUnits[nUnit]);
+
+	return szOut;
+}
+
+/* xorshift64, seeded the same every run so corpora are reproducible */
+uint64_t Random()
+{
+	mRandom ^= mRandom << 13;
+	mRandom ^= mRandom >> 7;
+	mRandom ^= mRandom << 17;
+
+	return mRandom;
+}
+
+void FillRandom(unsigned char* pBuffer, size_t szBuffer)
+{
+	uint64_t n;
+
+	for (size_t i = 0; i < szBuffer; i += sizeof(n))
+	{
+		n = Random();
+		memcpy(pBuffer + i, &n, sizeof(n));
+	}
+}
+
+/* runs of random bytes, 1 to 64K long */
+void FillRuns(unsigned char* pBuffer, size_t szBuffer)
+{
+	size_t i = 0;
+	size_t n;
+	unsigned char c;
+
+	while (i < szBuffer)
+	{
+		c = Random();
+		n = 1 + Random() % 65536;
+		while (n-- > 0 && i < szBuffer)
+		{
+			pBuffer[i++] = c;
+		}
+	}
+}
+
+/* service log lines: timestamps, levels, ids and padded fields */
+void FillText(unsigned char* pBuffer, size_t szBuffer)
+{
+	static char* pLevels[] = { "INFO ", "INFO ", "INFO ", "DEBUG", "WARN " };
+	static unsigned nSeconds = 0;
+	char szLine[160];
+	size_t i = 0;
+	int n;
+	uint64_t r;
+
+	while (i < szBuffer)
+	{
+		r = Random();
+		nSeconds += r % 3;
+		n = snprintf(szLine, sizeof(szLine),
+				"2026-10-18 %02u:%02u:%02u.%03u %s [worker-%u] request %08x "
+				"%-12s %6u us%s\n", nSeconds / 3600 % 24, nSeconds / 60 % 60,
+				nSeconds % 60, (unsigned) (r >> 8) % 1000, pLevels[r % 5],
+				(unsigned) (r >> 20) % 16, (unsigned) (r >> 24),
+				(r >> 56) % 4 ? "ok" : "retry", (unsigned) (r >> 40) % 100000,
+				(r >> 60) == 0 ? "          ------------------------" : "");
+		if (n > szBuffer - i)
+		{
+			n = szBuffer - i;
+		}
+		memcpy(pBuffer + i, szLine, n);
+		i += n;
+	}
+}
+
+/*
+ * Write a corpus of size bytes to szPath unless a file of that size is
+ * already there.
+ */
+void Generate(char* szPath, corpus_t* pCorpus, size_t size)
+{
+	struct stat s;
+	unsigned char* pBuffer;
+	size_t szChunk;
+	FILE* fp;
+
+	if (stat(szPath, &s) == 0 && s.st_size == size)
+	{
+		return;
+	}
+	fprintf(stderr, "generating %s\n", szPath);
+	if ((fp = fopen(szPath, "w")) == NULL)
+	{
+		printf("bench_pzip: cannot create %s\n", szPath);
+		exit(1);
+	}
+	pBuffer = Malloc(szGenBuffer);
+	if (pCorpus->fnFill == NULL)
+	{
+		// a hole-filled image with a block of text every 1/16th
+		if (ftruncate(fileno(fp), size) != 0)
+		{
+			printf("bench_pzip: cannot size %s\n", szPath);
+			exit(1);
+		}
+		for (size_t offset = 0; offset < size; offset += size / 16)
+		{
+			FillText(pBuffer, 4096);
+			fseeko(fp, offset, SEEK_SET);
+			fwrite(pBuffer, 1, 4096, fp);
+		}
+	}
+	else
+	{
+		for (size_t offset = 0; offset < size; offset += szChunk)
+		{
+			szChunk = size - offset < szGenBuffer ? size - offset : szGenBuffer;
+			pCorpus->fnFill(pBuffer, szChunk);
+			fwrite(pBuffer, 1, szChunk, fp);
+		}
+	}
+	if (fclose(fp) != 0)
+	{
+		printf("bench_pzip: cannot write %s\n", szPath);
+		exit(1);
+	}
+	free(pBuffer);
+}
+
+/*
+ * Compress one corpus with wzip and with pzip at 1, 2, 4, ... threads up
+ * to the CPU count, each with the default and two fixed chunk sizes.
+ */
+void BenchCorpus(char* szPath, char* szName, size_t size)
+{
+	char* pChunks[] = { NULL, "256K", "16M" };
+	int pThreads[MaxThreadCounts];
+	int nThreadCounts = 0;
+	int nCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	char szKey[96];
+	char szThreads[16];
+	char* argv[8];
+	double wzip;
+	int n;
+
+	for (int j = 1; j < nCpus && nThreadCounts < MaxThreadCounts - 1; j *= 2)
+	{
+		pThreads[nThreadCounts++] = j;
+	}
+	pThreads[nThreadCounts++] = nCpus > 1 ? nCpus : 1;
+
+	snprintf(szKey, sizeof(szKey), "%s wzip 1 -", szName);
+	argv[0] = mszWzip;
+	argv[1] = szPath;
+	argv[2] = NULL;
+	wzip = Measure(szKey, argv, size, 0);
+
+	for (int i = 0; i < nThreadCounts; i++)
+	{
+		for (int j = 0; j < sizeof(pChunks) / sizeof(char*); j++)
+		{
+			snprintf(szThreads, sizeof(szThreads), "%d", pThreads[i]);
+			snprintf(szKey, sizeof(szKey), "%s pzip %d %s", szName,
+						pThreads[i], pChunks[j] != NULL ? pChunks[j] : "auto");
+			n = 0;
+			argv[n++] = mszPzip;
+			argv[n++] = "-j";
+			argv[n++] = szThreads;
+			if (pChunks[j] != NULL)
+			{
+				argv[n++] = "--chunk-size";
+				argv[n++] = pChunks[j];
+			}
+			argv[n++] = szPath;
+			argv[n] = NULL;
+			Measure(szKey, argv, size, wzip);
+		}
+	}
+}
+
+/*
+ * Run argv at least nRepeats times on a corpus of size bytes, print its row
+ * and record its best rate under szKey, "<corpus> <prog> <threads> <chunk>".
+ * The rate is also shown as a multiple of wzip's, if that is given.
+ */
+double Measure(char* szKey, char** argv, size_t size, double wzip)
+{
+	struct rusage usage;
+	uint64_t ns;
+	uint64_t nsBest = 0;
+	uint64_t nsTotal = 0;
+	double cpu = 0;
+	long nRss = 0;
+	char szCorpus[64];
+	char szProg[16];
+	char szThreads[16];
+	char szChunk[16];
+	result_t* pResult;
+
+	for (int r = 0; r < nRepeats || (nsTotal < nsMinMeasure && r < MaxRepeats);
+			r++)
+	{
+		ns = Run(argv, &usage);
+		nsTotal += ns;
+		if (nsBest == 0 || ns < nsBest)
+		{
+			nsBest = ns;
+			cpu = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e9
+					+ (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e3;
+			cpu = 100 * cpu / ns;
+		}
+		if (usage.ru_maxrss > nRss)
+		{
+			nRss = usage.ru_maxrss;
+		}
+	}
+
+	if (mnResults == MaxResults)
+	{
+		printf("bench_pzip: too many results\n");
+		exit(1);
+	}
+	pResult = &mpResults[mnResults++];
+	strcpy(pResult->szKey, szKey);
+	pResult->rate = size / 1e6 / (nsBest / 1e9);
+
+	sscanf(szKey, "%63s %15s %15s %15s", szCorpus, szProg, szThreads,
+			szChunk);
+	printf("%-14s %-5s %3s %6s %10.1f %7.2f %9.1f %6.0f\n", szCorpus,
+			szProg, szThreads, szChunk, pResult->rate,
+			wzip > 0 ? pResult->rate / wzip : 1.0, nRss / 1024.0, cpu);
+	fflush(stdout);
+
+	return pResult->rate;
+}
+
+/*
+ * Run argv to completion with stdout on /dev/null and return the wall
+ * time taken. The child's resource usage is left in pUsage.
+ */
+uint64_t Run(char** argv, struct rusage* pUsage)
+{
+	uint64_t nsStart = NowNs();
+	pid_t pid;
+	int status;
+	int fd;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0)
+	{
+		printf("bench_pzip: fork failed\n");
+		exit(1);
+	}
+	if (pid == 0)
+	{
+		fd = Open("/dev/null", O_WRONLY);
+		dup2(fd, STDOUT_FILENO);
+		execv(argv[0], argv);
+		fprintf(stderr, "bench_pzip: cannot run %s\n", argv[0]);
+		_exit(127);
+	}
+	if (wait4(pid, &status, 0, pUsage) < 0 || !WIFEXITED(status)
+		|| WEXITSTATUS(status) != 0)
+	{
+		printf("bench_pzip: %s failed\n", argv[0]);
+		exit(1);
+	}
+
+	return NowNs() - nsStart;
+}
+
+/*
+ * Hold the results against the saved baseline, or with --save replace it.
+ */
+void CheckBaseline()
+{
+	char szPath[256];
+	char szLine[160];
+	char* pRate;
+	double rate;
+	FILE* fp;
+
+	snprintf(szPath, sizeof(szPath), "%s/%s", mszDir, BaselineName);
+	if (mSave)
+	{
+		if ((fp = fopen(szPath, "w")) == NULL)
+		{
+			printf("bench_pzip: cannot write %s\n", szPath);
+			exit(1);
+		}
+		for (int i = 0; i < mnResults; i++)
+		{
+			fprintf(fp, "%s %.1f\n", mpResults[i].szKey, mpResults[i].rate);
+		}
+		fclose(fp);
+		printf("saved baseline %s\n", szPath);
+		return;
+	}
+
+	if ((fp = fopen(szPath, "r")) == NULL)
+	{
+		printf("no baseline in %s; save one with --save\n", mszDir);
+		return;
+	}
+	while (fgets(szLine, sizeof(szLine), fp) != NULL)
+	{
+		// the rate follows the last space of the key
+		if ((pRate = strrchr(szLine, ' ')) == NULL)
+		{
+			continue;
+		}
+		*pRate++ = '\0';
+		rate = atof(pRate);
+		// wzip's rows are the reference, not under test
+		if (strstr(szLine, " pzip ") == NULL)
+		{
+			continue;
+		}
+		for (int i = 0; i < mnResults; i++)
+		{
+			if (strcmp(mpResults[i].szKey, szLine) == 0
+				&& mpResults[i].rate < rate * (1 - mThreshold / 100))
+			{
+				printf("REGRESSION %s: %.1f MB/s, baseline %.1f MB/s\n",
+						szLine, mpResults[i].rate, rate);
+				mnRegressions++;
+			}
+		}
+	}
+	fclose(fp);
+}
@@ -0,0 +1,126 @@
+/*
+ * Throughput of each FindRunEnd and CountRuns implementation on short-run
+ * and long-run data, in bytes per TSC cycle (bytes per ns off x86).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "runs.h"
+#include "stats.h"
+#include "utilities.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define Ticks() __rdtsc()
+#define TickUnit "cycle"
+#else
+#define Ticks() NowNs()
+#define TickUnit "ns"
+#endif
+
+#define szBench (64 << 20)
+#define nRepeats (5)
+
+/* fill pText with runs of random bytes whose lengths are 1..nMaxRun */
+void Fill(unsigned char* pText, size_t szText, int nMaxRun)
+{
+	size_t i = 0;
+	size_t n;
+	unsigned char c = 0;
+
+	while (i < szText)
+	{
+		c += 1 + rand() % 255;
+		n = 1 + rand() % nMaxRun;
+		while (n-- > 0 && i < szText)
+		{
+			pText[i++] = c;
+		}
+	}
+}
+
+/* best-of-nRepeats bytes per tick for splitting pText into runs */
+double Bench(runend_t fn, unsigned char* pText, size_t szText, size_t* pnRuns)
+{
+	unsigned long long start;
+	unsigned long long elapsed;
+	unsigned long long best = 0;
+	unsigned char* p;
+
+	for (int r = 0; r < nRepeats; r++)
+	{
+		*pnRuns = 0;
+		p = pText;
+		start = Ticks();
+		while (p < pText + szText)
+		{
+			p = fn(p, pText + szText);
+			(*pnRuns)++;
+		}
+		elapsed = Ticks() - start;
+		if (best == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	return (double) szText / best;
+}
+
+double BenchCount(runcount_t fn, unsigned char* pText, size_t szText, 
+					size_t* pnRuns)
+{
+	unsigned long long start;
+	unsigned long long elapsed;
+	unsigned long long best = 0;
+
+	for (int r = 0; r < nRepeats; r++)
+	{
+		start = Ticks();
+		*pnRuns = fn(pText, pText + szText);
+		elapsed = Ticks() - start;
+		if (best == 0 || elapsed < best)
+		{
+			best = elapsed;
+		}
+	}
+
+	return (double) szText / best;
+}
+
+int main()
+{
+	unsigned char* pText = Malloc(szBench);
+	int nMaxRuns[] = { 4, 16, 256, 65536 };
+	runend_t fns[] = { FindRunEndScalar, FindRunEndSse2, FindRunEndAvx2 };
+	runcount_t counts[] = { CountRunsScalar, CountRunsSse2, CountRunsAvx2 };
+	char* names[] = { "scalar", "sse2", "avx2" };
+	int nFns;
+	size_t nRuns;
+	double rate;
+
+	// InitRuns picks the widest supported, so bench everything up to it
+	InitRuns();
+	nFns = FindRunEnd == FindRunEndAvx2 ? 3 
+			: FindRunEnd == FindRunEndSse2 ? 2 : 1;
+	printf("selected: %s\n", RunsImplName());
+	for (int i = 0; i < sizeof(nMaxRuns) / sizeof(int); i++)
+	{
+		Fill(pText, szBench, nMaxRuns[i]);
+		printf("runs of 1..%d:\n", nMaxRuns[i]);
+		for (int j = 0; j < nFns; j++)
+		{
+			rate = Bench(fns[j], pText, szBench, &nRuns);
+			printf("\t%-6s %8.3f bytes/%s (%zu runs)\n", names[j], 
+					rate, TickUnit, nRuns);
+		}
+		for (int j = 0; j < nFns; j++)
+		{
+			rate = BenchCount(counts[j], pText, szBench, &nRuns);
+			printf("\tcount %-6s %8.3f bytes/%s (%zu runs)\n", names[j], 
+					rate, TickUnit, nRuns);
+		}
+	}
+	free(pText);
+
+	return 0;
+}
@@ -0,0 +1,307 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "io.h"
+#include "utilities.h"
+
+/* an io_uring instance driven through the raw system calls */
+typedef struct __uring_t
+{
+	int fd;
+	char* pSqRing;
+	size_t szSqRing;
+	char* pCqRing;
+	size_t szCqRing;
+	struct io_uring_sqe* pSqes;
+	size_t szSqes;
+	_Atomic(unsigned)* pSqTail;
+	unsigned* pSqMask;
+	unsigned* pSqArray;
+	_Atomic(unsigned)* pCqHead;
+	_Atomic(unsigned)* pCqTail;
+	unsigned* pCqMask;
+	struct io_uring_cqe* pCqes;
+} uring_t;
+
+/*
+ * Open an input for the given --io mode. IoDirect asks for O_DIRECT and
+ * falls back to ordinary reads on filesystems that refuse it.
+ */
+int OpenInput(char* szName, int io)
+{
+	int fd;
+
+	if (io == IoDirect)
+	{
+		fd = open(szName, O_RDONLY | O_DIRECT);
+		if (fd >= 0 || errno != EINVAL)
+		{
+			if (fd < 0)
+			{
+				printf("io.c:OpenInput:unable to open file\n");
+				exit(1);
+			}
+			return fd;
+		}
+	}
+
+	return Open(szName, O_RDONLY);
+}
+
+/*
+ * A reader whose buffers each hold szBuffer bytes, rounded up to
+ * szIoAlign. Direct readers read one chunk at a time; io_uring readers
+ * keep up to UringDepth reads in flight.
+ */
+reader_t* InitReader(int io, size_t szBuffer)
+{
+	reader_t* pReader = Malloc(sizeof(reader_t));
+
+	szBuffer = (szBuffer + szIoAlign - 1) / szIoAlign * szIoAlign;
+	pReader->io = io;
+	pReader->nDepth = io == IoUring ? UringDepth : 1;
+	pReader->nHead = 0;
+	pReader->nQueued = 0;
+	pReader->pUring = io == IoUring ? InitUring(UringDepth) : NULL;
+	for (int i = 0; i < pReader->nDepth; i++)
+	{
+		if (posix_memalign((void**) &pReader->pSlots[i].pBuffer, szIoAlign, 
+							szBuffer) != 0)
+		{
+			printf("io.c:InitReader:unable to allocate read buffer\n");
+			exit(1);
+		}
+	}
+
+	return pReader;
+}
+
+int ReaderFull(reader_t* pReader)
+{
+	return pReader->nQueued == pReader->nDepth;
+}
+
+int ReaderEmpty(reader_t* pReader)
+{
+	return pReader->nQueued == 0;
+}
+
+/*
+ * Start reading size bytes at offset of fd into the next free buffer.
+ * offset must be a multiple of szIoAlign; the read itself is rounded up
+ * to one. The reader must not be full.
+ */
+void ReaderSubmit(reader_t* pReader, int fd, off_t offset, size_t size, 
+					void* pTag)
+{
+	int nSlot = (pReader->nHead + pReader->nQueued) % pReader->nDepth;
+	readslot_t* pSlot = &pReader->pSlots[nSlot];
+
+	pSlot->fd = fd;
+	pSlot->offset = offset;
+	pSlot->size = size;
+	pSlot->nRead = 0;
+	pSlot->bDone = 0;
+	pSlot->pTag = pTag;
+	pReader->nQueued++;
+
+	if (pReader->io == IoUring)
+	{
+		UringSubmit(pReader->pUring, pSlot);
+	}
+}
+
+/*
+ * Wait for the oldest submitted read and return its buffer and tag, or
+ * NULL once nothing is queued. The buffer stays valid until the next
+ * ReaderSubmit.
+ */
+unsigned char* ReaderNext(reader_t* pReader, void** ppTag)
+{
+	readslot_t* pSlot = &pReader->pSlots[pReader->nHead];
+
+	if (pReader->nQueued == 0)
+	{
+		return NULL;
+	}
+
+	while (pReader->io == IoUring && !pSlot->bDone)
+	{
+		UringComplete(pReader->pUring);
+	}
+	if (pSlot->nRead < 0)
+	{
+		printf("io.c:ReaderNext:read failed: %s\n", strerror(-pSlot->nRead));
+		exit(1);
+	}
+	// short io_uring reads and all direct reads finish here
+	ReadRest(pSlot);
+
+	pReader->nHead = (pReader->nHead + 1) % pReader->nDepth;
+	pReader->nQueued--;
+	*ppTag = pSlot->pTag;
+
+	return pSlot->pBuffer;
+}
+
+/*
+ * pread the rest of a slot's chunk, keeping every read aligned.
+ */
+void ReadRest(readslot_t* pSlot)
+{
+	size_t szAligned = (pSlot->size + szIoAlign - 1) / szIoAlign * szIoAlign;
+	size_t nAligned;
+	ssize_t nRead;
+
+	while (pSlot->nRead < pSlot->size)
+	{
+		// restart from the last aligned offset reached
+		nAligned = pSlot->nRead / szIoAlign * szIoAlign;
+		nRead = pread(pSlot->fd, pSlot->pBuffer + nAligned, 
+						szAligned - nAligned, pSlot->offset + nAligned);
+		if (nRead < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		if (nRead <= 0)
+		{
+			printf("io.c:ReadRest:read failed\n");
+			exit(1);
+		}
+		pSlot->nRead = nAligned + nRead;
+	}
+}
+
+void DestroyReader(reader_t* pReader)
+{
+	for (int i = 0; i < pReader->nDepth; i++)
+	{
+		free(pReader->pSlots[i].pBuffer);
+	}
+	if (pReader->pUring != NULL)
+	{
+		DestroyUring(pReader->pUring);
+	}
+	free(pReader);
+}
+
+uring_t* InitUring(int nEntries)
+{
+	uring_t* pUring = Malloc(sizeof(uring_t));
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+	pUring->fd = syscall(__NR_io_uring_setup, nEntries, &params);
+	if (pUring->fd < 0)
+	{
+		printf("io.c:InitUring:io_uring unavailable: %s\n", strerror(errno));
+		exit(1);
+	}
+
+	pUring->szSqRing = params.sq_off.array + params.sq_entries 
+						* sizeof(unsigned);
+	pUring->szCqRing = params.cq_off.cqes + params.cq_entries 
+						* sizeof(struct io_uring_cqe);
+	pUring->szSqes = params.sq_entries * sizeof(struct io_uring_sqe);
+	pUring->pSqRing = Mmap(NULL, pUring->szSqRing, PROT_READ | PROT_WRITE, 
+							MAP_SHARED | MAP_POPULATE, pUring->fd, 
+							IORING_OFF_SQ_RING);
+	pUring->pCqRing = Mmap(NULL, pUring->szCqRing, PROT_READ | PROT_WRITE, 
+							MAP_SHARED | MAP_POPULATE, pUring->fd, 
+							IORING_OFF_CQ_RING);
+	pUring->pSqes = Mmap(NULL, pUring->szSqes, PROT_READ | PROT_WRITE, 
+							MAP_SHARED | MAP_POPULATE, pUring->fd, 
+							IORING_OFF_SQES);
+
+	pUring->pSqTail = (void*) (pUring->pSqRing + params.sq_off.tail);
+	pUring->pSqMask = (void*) (pUring->pSqRing + params.sq_off.ring_mask);
+	pUring->pSqArray = (void*) (pUring->pSqRing + params.sq_off.array);
+	pUring->pCqHead = (void*) (pUring->pCqRing + params.cq_off.head);
+	pUring->pCqTail = (void*) (pUring->pCqRing + params.cq_off.tail);
+	pUring->pCqMask = (void*) (pUring->pCqRing + params.cq_off.ring_mask);
+	pUring->pCqes = (void*) (pUring->pCqRing + params.cq_off.cqes);
+
+	return pUring;
+}
+
+/*
+ * Queue one read of a slot's buffer, rounded up to szIoAlign, and enter
+ * the kernel to start it. sqe->len is 32 bits, so a read is cut at
+ * szUringMaxRead and ReadRest preads the rest of a larger chunk.
+ */
+void UringSubmit(uring_t* pUring, readslot_t* pSlot)
+{
+	unsigned tail = atomic_load_explicit(pUring->pSqTail, 
+											memory_order_relaxed);
+	unsigned index = tail & *pUring->pSqMask;
+	struct io_uring_sqe* pSqe = &pUring->pSqes[index];
+	size_t szRead = (pSlot->size + szIoAlign - 1) / szIoAlign * szIoAlign;
+
+	memset(pSqe, 0, sizeof(*pSqe));
+	pSqe->opcode = IORING_OP_READ;
+	pSqe->fd = pSlot->fd;
+	pSqe->off = pSlot->offset;
+	pSqe->addr = (unsigned long) pSlot->pBuffer;
+	pSqe->len = szRead < szUringMaxRead ? szRead : szUringMaxRead;
+	pSqe->user_data = (unsigned long) pSlot;
+	pUring->pSqArray[index] = index;
+	atomic_store_explicit(pUring->pSqTail, tail + 1, memory_order_release);
+
+	while (syscall(__NR_io_uring_enter, pUring->fd, 1, 0, 0, NULL, 0) < 0)
+	{
+		if (errno != EINTR)
+		{
+			printf("io.c:UringSubmit:io_uring_enter failed\n");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Wait for at least one completion and mark the slots it finishes.
+ */
+void UringComplete(uring_t* pUring)
+{
+	unsigned head = atomic_load_explicit(pUring->pCqHead, 
+											memory_order_relaxed);
+	struct io_uring_cqe* pCqe;
+	readslot_t* pSlot;
+
+	while (head == atomic_load_explicit(pUring->pCqTail, memory_order_acquire))
+	{
+		if (syscall(__NR_io_uring_enter, pUring->fd, 0, 1, 
+					IORING_ENTER_GETEVENTS, NULL, 0) < 0 && errno != EINTR)
+		{
+			printf("io.c:UringComplete:io_uring_enter failed\n");
+			exit(1);
+		}
+	}
+
+	do
+	{
+		pCqe = &pUring->pCqes[head & *pUring->pCqMask];
+		pSlot = (readslot_t*) (unsigned long) pCqe->user_data;
+		pSlot->nRead = pCqe->res;
+		pSlot->bDone = 1;
+		head++;
+	} while (head != atomic_load_explicit(pUring->pCqTail, 
+											memory_order_acquire));
+	atomic_store_explicit(pUring->pCqHead, head, memory_order_release);
+}
+
+void DestroyUring(uring_t* pUring)
+{
+	Munmap(pUring->pSqes, pUring->szSqes);
+	Munmap(pUring->pCqRing, pUring->szCqRing);
+	Munmap(pUring->pSqRing, pUring->szSqRing);
+	Close(pUring->fd);
+	free(pUring);
+}
@@ -0,0 +1,61 @@
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * Chunk readers for the read-based --io modes. A reader owns a small
+ * FIFO of aligned buffers: reads are submitted into free buffers and
+ * handed back in submission order, so a worker never gets ahead of a
+ * chunk it has claimed.
+ */
+#define IoMmap (0)
+#define IoDirect (1)
+#define IoUring (2)
+
+/* alignment of O_DIRECT offsets, lengths and buffers */
+#define szIoAlign (4096)
+/* reads kept in flight per io_uring reader */
+#define UringDepth (4)
+/* longest io_uring read: an aligned length whose count fits cqe->res */
+#define szUringMaxRead (0x7FFFF000)
+
+typedef struct __reader_t reader_t;
+typedef struct __readslot_t readslot_t;
+typedef struct __uring_t uring_t;
+
+typedef struct __readslot_t
+{
+	unsigned char* pBuffer;
+	int fd;
+	off_t offset;
+	size_t size;
+	/* bytes read so far, or -errno once a read has failed */
+	ssize_t nRead;
+	int bDone;
+	void* pTag;
+} readslot_t;
+
+typedef struct __reader_t
+{
+	int io;
+	int nDepth;
+	readslot_t pSlots[UringDepth];
+	/* oldest submitted slot and number of slots in use */
+	int nHead;
+	int nQueued;
+	/* IoUring only */
+	uring_t* pUring;
+} reader_t;
+
+int OpenInput(char* szName, int io);
+reader_t* InitReader(int io, size_t szBuffer);
+int ReaderFull(reader_t* pReader);
+int ReaderEmpty(reader_t* pReader);
+void ReaderSubmit(reader_t* pReader, int fd, off_t offset, size_t size, 
+					void* pTag);
+unsigned char* ReaderNext(reader_t* pReader, void** ppTag);
+void DestroyReader(reader_t* pReader);
+void ReadRest(readslot_t* pSlot);
+uring_t* InitUring(int nEntries);
+void UringSubmit(uring_t* pUring, readslot_t* pSlot);
+void UringComplete(uring_t* pUring);
+void DestroyUring(uring_t* pUring);
@@ -0,0 +1,143 @@
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "numa.h"
+#include "utilities.h"
+
+#define NodeDir "/sys/devices/system/node"
+
+typedef struct __numanode_t
+{
+	int id;
+	cpu_set_t cpus;
+} numanode_t;
+
+void ParseCpuList(char* szList, cpu_set_t* pCpus);
+
+numanode_t mpNumaNodes[MaxNodes];
+int mnNumaNodes = 0;
+
+/*
+ * Find the online nodes that have CPUs and return how many there are.
+ * Without NUMA information the machine is one node holding every CPU.
+ */
+int InitNuma()
+{
+	numanode_t* pNodes = mpNumaNodes;
+	DIR* pDir;
+	struct dirent* pEntry;
+	FILE* fp;
+	char szPath[256];
+	char szList[4096];
+	int nNodes = 0;
+	int id;
+
+	if (mnNumaNodes > 0)
+	{
+		return mnNumaNodes;
+	}
+
+	if ((pDir = opendir(NodeDir)) != NULL)
+	{
+		while ((pEntry = readdir(pDir)) != NULL && nNodes < MaxNodes)
+		{
+			if (sscanf(pEntry->d_name, "node%d", &id) != 1)
+			{
+				continue;
+			}
+			snprintf(szPath, sizeof(szPath), NodeDir "/node%d/cpulist", id);
+			if ((fp = fopen(szPath, "r")) == NULL)
+			{
+				continue;
+			}
+			if (fgets(szList, sizeof(szList), fp) != NULL)
+			{
+				pNodes[nNodes].id = id;
+				ParseCpuList(szList, &pNodes[nNodes].cpus);
+				if (CPU_COUNT(&pNodes[nNodes].cpus) > 0)
+				{
+					nNodes++;
+				}
+			}
+			fclose(fp);
+		}
+		closedir(pDir);
+	}
+
+	if (nNodes == 0)
+	{
+		pNodes[0].id = 0;
+		sched_getaffinity(0, sizeof(cpu_set_t), &pNodes[0].cpus);
+		nNodes = 1;
+	}
+	mnNumaNodes = nNodes;
+
+	return nNodes;
+}
+
+int NodeId(int nNode)
+{
+	return mpNumaNodes[nNode].id;
+}
+
+/*
+ * Parse a kernel CPU list such as "0-3,8-11".
+ */
+void ParseCpuList(char* szList, cpu_set_t* pCpus)
+{
+	char* p = szList;
+	char* pEnd;
+	long first;
+	long last;
+
+	CPU_ZERO(pCpus);
+	while (*p >= '0' && *p <= '9')
+	{
+		first = strtol(p, &pEnd, 10);
+		last = first;
+		if (*pEnd == '-')
+		{
+			last = strtol(pEnd + 1, &pEnd, 10);
+		}
+		for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++)
+		{
+			CPU_SET(cpu, pCpus);
+		}
+		p = *pEnd == ',' ? pEnd + 1 : pEnd;
+	}
+}
+
+/*
+ * Restrict the calling thread to the CPUs of node nNode.
+ */
+void PinToNode(int nNode)
+{
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), 
+								&mpNumaNodes[nNode].cpus) != 0)
+	{
+		printf("numa.c:PinToNode:unable to set thread affinity\n");
+		exit(1);
+	}
+}
+
+/*
+ * The node the calling thread is running on right now.
+ */
+int CurrentNode()
+{
+	unsigned cpu;
+	unsigned node;
+
+	if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+	{
+		return 0;
+	}
+
+	return node;
+}
@@ -0,0 +1,13 @@
+/*
+ * NUMA topology from /sys/devices/system/node, for pinning workers
+ * without a libnuma dependency. Memory placement follows from pinning:
+ * buffers a pinned worker allocates and first touches are node-local.
+ * Nodes are numbered 0 .. InitNuma() - 1 here; NodeId gives the system's
+ * number for one.
+ */
+#define MaxNodes (64)
+
+int InitNuma();
+int NodeId(int nNode);
+void PinToNode(int nNode);
+int CurrentNode();
@@ -0,0 +1,86 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pool.h"
+#include "utilities.h"
+
+pool_t* InitPool(size_t szObject)
+{
+	pool_t* pPool = Malloc(sizeof(pool_t));
+	pPool->szObject = szObject;
+	pPool->pFree = NULL;
+	atomic_init(&pPool->pReturned, NULL);
+	pPool->nObjects = 0;
+
+	return pPool;
+}
+
+/*
+ * Take an object from the pool, falling back to the objects other threads
+ * have returned and then to malloc. Owner thread only. New objects are
+ * zeroed; a recycled one keeps whatever its last user left in it.
+ */
+void* PoolGet(pool_t* pPool)
+{
+	poolnode_t* pNode;
+
+	if (pPool->pFree == NULL)
+	{
+		pPool->pFree = atomic_exchange(&pPool->pReturned, NULL);
+	}
+	if (pPool->pFree != NULL)
+	{
+		pNode = pPool->pFree;
+		pPool->pFree = pNode->pNext;
+	}
+	else
+	{
+		pNode = Malloc(sizeof(poolnode_t) + pPool->szObject);
+		memset(pNode + 1, 0, pPool->szObject);
+		pNode->pOwner = pPool;
+		pPool->nObjects++;
+	}
+
+	return pNode + 1;
+}
+
+/*
+ * Hand an object back to the pool that allocated it. Safe from any thread.
+ */
+void PoolPut(void* pObject)
+{
+	poolnode_t* pNode = (poolnode_t*) pObject - 1;
+	pool_t* pPool = pNode->pOwner;
+
+	pNode->pNext = atomic_load(&pPool->pReturned);
+	while (!atomic_compare_exchange_weak(&pPool->pReturned, 
+				&pNode->pNext, pNode))
+	{
+	}
+}
+
+/*
+ * Free the pool and every object that has been returned to it, calling
+ * fnDestroy (if not NULL) on each object first.
+ */
+void DestroyPool(pool_t* pPool, void (*fnDestroy)(void*))
+{
+	poolnode_t* pNode;
+	poolnode_t* pNext;
+
+	for (int i = 0; i < 2; i++)
+	{
+		pNode = i == 0 ? pPool->pFree : atomic_load(&pPool->pReturned);
+		while (pNode != NULL)
+		{
+			pNext = pNode->pNext;
+			if (fnDestroy != NULL)
+			{
+				fnDestroy(pNode + 1);
+			}
+			free(pNode);
+			pNode = pNext;
+		}
+	}
+	free(pPool);
+}
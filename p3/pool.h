@@ -0,0 +1,32 @@
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * Per-thread object pool. Only the owning thread takes objects out; any
+ * thread may hand one back, and it returns to the pool it came from.
+ * Each object is preceded by a poolnode_t naming its owner.
+ */
+typedef struct __pool_t pool_t;
+typedef struct __poolnode_t poolnode_t;
+
+typedef struct __poolnode_t
+{
+	pool_t* pOwner;
+	poolnode_t* pNext;
+} poolnode_t;
+
+typedef struct __pool_t
+{
+	size_t szObject;
+	/* free objects only the owner touches */
+	poolnode_t* pFree;
+	/* objects handed back by other threads, taken by the owner in one swap */
+	_Atomic(poolnode_t*) pReturned;
+	/* objects ever allocated by this pool */
+	size_t nObjects;
+} pool_t;
+
+pool_t* InitPool(size_t szObject);
+void* PoolGet(pool_t* pPool);
+void PoolPut(void* pObject);
+void DestroyPool(pool_t* pPool, void (*fnDestroy)(void*));
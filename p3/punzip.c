@@ -0,0 +1,641 @@
+/*
+ * Parallel decompressor for pzip streams.
+ *
+ * Each input is mapped and indexed as a list of ranges of records, each
+ * with the offset of its first byte in the decompressed output. A raw
+ * stream is cut into ranges of RangeRecords records whose run lengths
+ * workers sum in parallel, and a prefix sum over the totals gives the
+ * offsets; a framed stream (rle.h) carries an index of its frames, which
+ * become the ranges directly; a varint stream is cut every RangeTokens
+ * tokens in one sequential scan, as its tokens vary in length. The output
+ * is then cut into blocks that workers expand concurrently: straight into a
+ * mapping of the output file when it is a regular file, otherwise into
+ * buffers written to stdout in order.
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "pool.h"
+#include "punzip.h"
+#include "ring.h"
+#include "rle.h"
+#include "utilities.h"
+
+#define RangeRecords (64 << 10)
+#define RangeTokens (64 << 10)
+#define szBlock (4 << 20)
+#define RingSlotsPerThread (4)
+#define Usage "punzip: [-j threads] [-o output] [--offset N] [--length N] " \
+				"file1 [file2 ...]\n"
+
+/* consecutive records that decompress to output starting at offset */
+typedef struct __zrange_t
+{
+	ubyte_t* pRecords;
+	size_t szRecords;
+	uint64_t offset;
+} zrange_t;
+
+/* a mapped input and its ranges in output order */
+typedef struct __zipindex_t
+{
+	ubyte_t* pZip;
+	size_t szZip;
+	/* FormatVarint, or FormatRaw for the 5-byte records of the others */
+	int format;
+	size_t nRanges;
+	zrange_t* pRanges;
+	/* decompressed size */
+	uint64_t size;
+} zipindex_t;
+
+/* a decompressed block waiting to be written to a non-seekable output */
+typedef struct __block_t
+{
+	size_t size;
+	ubyte_t data[szBlock];
+} block_t;
+
+typedef struct __worker_t
+{
+	pthread_t thread;
+	pool_t* pPool;
+} worker_t;
+
+int mnThreads = 0;
+worker_t* mpWorkers;
+
+/* the part of each input's output to produce, from --offset and --length */
+uint64_t mStart = 0;
+uint64_t mLength = UINT64_MAX;
+
+int mOutFd = STDOUT_FILENO;
+/* set when the output is a regular file that can be mapped */
+int mMapOutput = 0;
+/* bytes written to the output by earlier inputs */
+off_t mOutOffset = 0;
+
+/* the mapped window of the output for the current input */
+ubyte_t* mpOutMap;
+size_t mszOutMap;
+/* offset of the current input's first output byte within mpOutMap */
+size_t mOutMapSkew;
+
+zipindex_t mIndex;
+/* output bytes [mWindowStart, mWindowEnd) of the current input */
+uint64_t mWindowStart;
+uint64_t mWindowEnd;
+size_t mnBlocks;
+/* ring index of the current input's first block */
+size_t mnBlockBase = 0;
+/* next unclaimed range or block of the current phase */
+atomic_size_t mNext;
+ring_t* mpBlockRing;
+
+int main(int argc, char** argv)
+{
+	struct stat s;
+
+	argc = ParseArgs(argc, argv);
+
+	// a shared mapping needs a regular file opened for reading as well
+	Fstat(mOutFd, &s);
+	if (S_ISREG(s.st_mode) && (fcntl(mOutFd, F_GETFL) & O_ACCMODE) == O_RDWR)
+	{
+		mMapOutput = 1;
+		mOutOffset = lseek(mOutFd, 0, SEEK_CUR);
+	}
+
+	mpWorkers = Malloc(sizeof(worker_t) * mnThreads);
+	for (int i = 0; i < mnThreads; i++)
+	{
+		mpWorkers[i].pPool = InitPool(sizeof(block_t));
+	}
+	mpBlockRing = InitRing(RingSlotsPerThread * mnThreads);
+
+	for (int i = 1; i < argc; i++)
+	{
+		UnzipFile(argv[i]);
+	}
+
+	if (mMapOutput)
+	{
+		lseek(mOutFd, mOutOffset, SEEK_SET);
+	}
+	DestroyRing(mpBlockRing);
+	for (int i = 0; i < mnThreads; i++)
+	{
+		DestroyPool(mpWorkers[i].pPool, NULL);
+	}
+	free(mpWorkers);
+
+	return 0;
+}
+
+/*
+ * Consume -j N, -o output, --offset N and --length N, leaving only the
+ * inputs in argv, and return the new argc. --offset and --length select
+ * part of each input's decompressed output.
+ */
+int ParseArgs(int argc, char** argv)
+{
+	int nArgs = 1;
+	char* pEnd;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			mnThreads = strtol(argv[++i], &pEnd, 10);
+			if (*pEnd != '\0' || mnThreads < 1)
+			{
+				printf("punzip: invalid thread count '%s'\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+		{
+			mOutFd = open(argv[++i], O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if (mOutFd < 0)
+			{
+				printf("punzip: cannot open '%s'\n", argv[i]);
+				exit(1);
+			}
+		}
+		else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc)
+		{
+			mStart = ParseOffset(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc)
+		{
+			mLength = ParseOffset(argv[++i]);
+		}
+		else
+		{
+			argv[nArgs++] = argv[i];
+		}
+	}
+
+	if (nArgs < 2)
+	{
+		printf(Usage);
+		exit(1);
+	}
+	argv[nArgs] = NULL;
+
+	if (mnThreads == 0)
+	{
+		mnThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (mnThreads < 1)
+		{
+			mnThreads = 1;
+		}
+	}
+
+	return nArgs;
+}
+
+uint64_t ParseOffset(char* szValue)
+{
+	char* pEnd;
+	uint64_t n;
+
+	n = strtoull(szValue, &pEnd, 10);
+	if (szValue[0] < '0' || szValue[0] > '9' || *pEnd != '\0')
+	{
+		printf("punzip: invalid offset '%s'\n", szValue);
+		exit(1);
+	}
+
+	return n;
+}
+
+void UnzipFile(char* szName)
+{
+	int fd;
+	struct stat s;
+	uint64_t szWindow;
+
+	fd = Open(szName, O_RDONLY);
+	Fstat(fd, &s);
+	if (!S_ISREG(s.st_mode))
+	{
+		printf("punzip: %s: inputs must be regular files\n", szName);
+		exit(1);
+	}
+	if (s.st_size == 0)
+	{
+		Close(fd);
+		return;
+	}
+
+	mIndex.pZip = Mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	mIndex.szZip = s.st_size;
+	mIndex.format = FormatRaw;
+	switch (StreamFormat(mIndex.pZip, mIndex.szZip))
+	{
+		case FormatFramed: IndexFramed(szName); break;
+		case FormatVarint: IndexVarint(szName); break;
+		default: IndexRaw(szName); break;
+	}
+
+	mWindowStart = mStart < mIndex.size ? mStart : mIndex.size;
+	szWindow = mIndex.size - mWindowStart;
+	mWindowEnd = mWindowStart + (mLength < szWindow ? mLength : szWindow);
+	szWindow = mWindowEnd - mWindowStart;
+
+	mnBlocks = (szWindow + szBlock - 1) / szBlock;
+	atomic_store(&mNext, 0);
+	if (mMapOutput)
+	{
+		MapOutput(szWindow);
+		RunWorkers(ExpandBlocks);
+		UnmapOutput();
+		mOutOffset += szWindow;
+	}
+	else
+	{
+		RunWorkers(ExpandBlocks);
+		// ring indices carry on into the next input's blocks
+		mnBlockBase += mnBlocks;
+	}
+
+	Munmap(mIndex.pZip, mIndex.szZip);
+	Close(fd);
+	free(mIndex.pRanges);
+}
+
+/*
+ * Index a raw stream: cut it into ranges of RangeRecords records, sum
+ * each range's run lengths in parallel and prefix-sum the totals.
+ */
+void IndexRaw(char* szName)
+{
+	size_t nRecords;
+	uint64_t szRange;
+
+	if (mIndex.szZip % szRleBytes != 0)
+	{
+		printf("punzip: %s: truncated record\n", szName);
+		exit(1);
+	}
+
+	nRecords = mIndex.szZip / szRleBytes;
+	mIndex.nRanges = (nRecords + RangeRecords - 1) / RangeRecords;
+	mIndex.pRanges = Malloc(sizeof(zrange_t) * mIndex.nRanges);
+	for (size_t r = 0; r < mIndex.nRanges; r++)
+	{
+		mIndex.pRanges[r].pRecords = mIndex.pZip 
+										+ szRleBytes * RangeRecords * r;
+		mIndex.pRanges[r].szRecords = szRleBytes * RangeRecords;
+	}
+	mIndex.pRanges[mIndex.nRanges - 1].szRecords = 
+		szRleBytes * (nRecords - RangeRecords * (mIndex.nRanges - 1));
+
+	atomic_store(&mNext, 0);
+	RunWorkers(SumRanges);
+
+	mIndex.size = 0;
+	for (size_t r = 0; r < mIndex.nRanges; r++)
+	{
+		szRange = mIndex.pRanges[r].offset;
+		mIndex.pRanges[r].offset = mIndex.size;
+		mIndex.size += szRange;
+	}
+}
+
+/*
+ * Index a framed stream from its trailing frame index. Only the index
+ * and the last frame's header are read; frames are touched when expanded.
+ */
+void IndexFramed(char* szName)
+{
+	ubyte_t* pTrailer = mIndex.pZip + mIndex.szZip - szTrailer;
+	ubyte_t* pEntry;
+	ubyte_t* pHeader;
+	uint64_t nIndexOffset;
+	uint64_t nFrames;
+	uint64_t nFrameOffset;
+	uint64_t nNextOffset;
+
+	if (mIndex.szZip < szRleBytes + szTrailer 
+		|| memcmp(pTrailer + 16, IndexMagic, 8) != 0)
+	{
+		printf("punzip: %s: missing frame index\n", szName);
+		exit(1);
+	}
+	nIndexOffset = Unpack64(pTrailer);
+	nFrames = Unpack64(pTrailer + 8);
+	if (nIndexOffset < szRleBytes 
+		|| nIndexOffset > mIndex.szZip - szTrailer
+		|| nFrames * szIndexEntry != mIndex.szZip - szTrailer - nIndexOffset)
+	{
+		printf("punzip: %s: corrupt frame index\n", szName);
+		exit(1);
+	}
+
+	mIndex.nRanges = nFrames;
+	mIndex.pRanges = Malloc(sizeof(zrange_t) * nFrames);
+	pEntry = mIndex.pZip + nIndexOffset;
+	for (size_t f = 0; f < nFrames; f++, pEntry += szIndexEntry)
+	{
+		nFrameOffset = Unpack64(pEntry);
+		nNextOffset = f + 1 < nFrames ? Unpack64(pEntry + szIndexEntry) 
+										: nIndexOffset;
+		if (nFrameOffset < szRleBytes || nNextOffset > nIndexOffset
+			|| nFrameOffset + szFrameHeader > nNextOffset
+			|| (nNextOffset - nFrameOffset - szFrameHeader) % szRleBytes != 0
+			|| (f > 0 && Unpack64(pEntry + 8) < mIndex.pRanges[f - 1].offset))
+		{
+			printf("punzip: %s: corrupt frame index\n", szName);
+			exit(1);
+		}
+		mIndex.pRanges[f].pRecords = mIndex.pZip + nFrameOffset 
+										+ szFrameHeader;
+		mIndex.pRanges[f].szRecords = nNextOffset - nFrameOffset 
+										- szFrameHeader;
+		mIndex.pRanges[f].offset = Unpack64(pEntry + 8);
+	}
+
+	mIndex.size = 0;
+	if (nFrames > 0)
+	{
+		pHeader = mIndex.pRanges[nFrames - 1].pRecords - szFrameHeader;
+		mIndex.size = mIndex.pRanges[nFrames - 1].offset 
+						+ Unpack64(pHeader + 8);
+	}
+}
+
+/*
+ * Index a varint stream by walking its tokens, starting a range every
+ * RangeTokens tokens.
+ */
+void IndexVarint(char* szName)
+{
+	ubyte_t* p = mIndex.pZip + szRleBytes;
+	ubyte_t* pEnd = mIndex.pZip + mIndex.szZip;
+	ubyte_t* pRangeStart = p;
+	size_t nTokens = 0;
+	size_t nCapacity = 16;
+	size_t szHeader;
+	uint64_t n;
+	uint64_t offset = 0;
+
+	mIndex.format = FormatVarint;
+	mIndex.nRanges = 0;
+	mIndex.pRanges = Malloc(sizeof(zrange_t) * nCapacity);
+	mIndex.size = 0;
+	while (p < pEnd)
+	{
+		szHeader = UnpackVarint(p, pEnd, &n);
+		if (szHeader == 0 || (uint64_t) (pEnd - p - szHeader) 
+								< ((n & 1) ? n >> 1 : 1))
+		{
+			printf("punzip: %s: truncated token\n", szName);
+			exit(1);
+		}
+		p += szHeader + ((n & 1) ? n >> 1 : 1);
+		mIndex.size += n >> 1;
+		if (++nTokens == RangeTokens || p == pEnd)
+		{
+			if (mIndex.nRanges == nCapacity)
+			{
+				nCapacity *= 2;
+				mIndex.pRanges = Realloc(mIndex.pRanges, 
+										sizeof(zrange_t) * nCapacity);
+			}
+			mIndex.pRanges[mIndex.nRanges].pRecords = pRangeStart;
+			mIndex.pRanges[mIndex.nRanges].szRecords = p - pRangeStart;
+			mIndex.pRanges[mIndex.nRanges].offset = offset;
+			mIndex.nRanges++;
+			pRangeStart = p;
+			offset = mIndex.size;
+			nTokens = 0;
+		}
+	}
+}
+
+/*
+ * Run fnWork on every worker, and for non-seekable output write the
+ * blocks they produce from this thread while they run.
+ */
+void RunWorkers(void* (*fnWork)(void*))
+{
+	for (int i = 0; i < mnThreads; i++)
+	{
+		PthreadCreate(&mpWorkers[i].thread, NULL, fnWork, &mpWorkers[i]);
+	}
+	if (fnWork == ExpandBlocks && !mMapOutput)
+	{
+		WriteBlocks();
+	}
+	for (int i = 0; i < mnThreads; i++)
+	{
+		PthreadJoin(mpWorkers[i].thread, NULL);
+	}
+}
+
+/*
+ * Store the total run length of each claimed range in its offset.
+ */
+void* SumRanges(void* arg)
+{
+	size_t r;
+	zrange_t* pRange;
+	uint64_t szRange;
+
+	while ((r = atomic_fetch_add(&mNext, 1)) < mIndex.nRanges)
+	{
+		pRange = &mIndex.pRanges[r];
+		szRange = 0;
+		for (size_t n = 0; n < pRange->szRecords; n += szRleBytes)
+		{
+			szRange += UnpackCount(pRange->pRecords + n);
+		}
+		pRange->offset = szRange;
+	}
+
+	return NULL;
+}
+
+/*
+ * Expand claimed blocks of the output window, into the output mapping or
+ * into a pooled buffer handed to WriteBlocks through the ring.
+ */
+void* ExpandBlocks(void* arg)
+{
+	worker_t* pWorker = arg;
+	size_t b;
+	uint64_t start;
+	uint64_t end;
+	block_t* pBlock;
+
+	while ((b = atomic_fetch_add(&mNext, 1)) < mnBlocks)
+	{
+		start = mWindowStart + b * szBlock;
+		end = start + szBlock < mWindowEnd ? start + szBlock : mWindowEnd;
+		if (mMapOutput)
+		{
+			ExpandRange(&mIndex, start, end, 
+						mpOutMap + mOutMapSkew + (start - mWindowStart));
+		}
+		else
+		{
+			pBlock = PoolGet(pWorker->pPool);
+			pBlock->size = end - start;
+			ExpandRange(&mIndex, start, end, pBlock->data);
+			RingPut(mpBlockRing, mnBlockBase + b, pBlock);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Write output bytes [start, end) of pIndex to pOut. The range holding
+ * start is found by binary search, its first record by a scan within it.
+ */
+void ExpandRange(zipindex_t* pIndex, uint64_t start, uint64_t end, 
+					ubyte_t* pOut)
+{
+	size_t lo = 0;
+	size_t hi = pIndex->nRanges;
+	size_t mid;
+	uint64_t pos;
+	uint64_t szRun;
+	uint64_t szCopy;
+	uint64_t n;
+	int bLiteral;
+	ubyte_t* p;
+	ubyte_t* pRangeEnd;
+	ubyte_t* pData;
+
+	// last range starting at or before start
+	while (hi - lo > 1)
+	{
+		mid = (lo + hi) / 2;
+		if (pIndex->pRanges[mid].offset <= start)
+		{
+			lo = mid;
+		}
+		else
+		{
+			hi = mid;
+		}
+	}
+
+	p = pIndex->pRanges[lo].pRecords;
+	pRangeEnd = p + pIndex->pRanges[lo].szRecords;
+	pos = pIndex->pRanges[lo].offset;
+	while (start < end)
+	{
+		if (p == pRangeEnd)
+		{
+			if (++lo == pIndex->nRanges)
+			{
+				break;
+			}
+			p = pIndex->pRanges[lo].pRecords;
+			pRangeEnd = p + pIndex->pRanges[lo].szRecords;
+			pos = pIndex->pRanges[lo].offset;
+			continue;
+		}
+
+		if (pIndex->format == FormatVarint)
+		{
+			// IndexVarint has checked every token
+			p += UnpackVarint(p, pRangeEnd, &n);
+			szRun = n >> 1;
+			bLiteral = n & 1;
+			pData = p;
+			p += bLiteral ? szRun : 1;
+		}
+		else
+		{
+			szRun = UnpackCount(p);
+			bLiteral = 0;
+			pData = p + szRleBytes - 1;
+			p += szRleBytes;
+		}
+
+		if (pos + szRun > start)
+		{
+			szCopy = (pos + szRun < end ? pos + szRun : end) - start;
+			if (bLiteral)
+			{
+				memcpy(pOut, pData + (start - pos), szCopy);
+			}
+			else
+			{
+				memset(pOut, *pData, szCopy);
+			}
+			pOut += szCopy;
+			start += szCopy;
+		}
+		pos += szRun;
+	}
+}
+
+/*
+ * Write the current input's blocks to the output in order.
+ */
+void WriteBlocks()
+{
+	block_t* pBlock;
+	ssize_t out;
+	size_t szDone;
+
+	for (size_t b = 0; b < mnBlocks; b++)
+	{
+		pBlock = RingGet(mpBlockRing, mnBlockBase + b);
+		for (szDone = 0; szDone < pBlock->size; szDone += out)
+		{
+			out = write(mOutFd, pBlock->data + szDone, pBlock->size - szDone);
+			if (out < 0)
+			{
+				printf("punzip: write failed\n");
+				exit(1);
+			}
+		}
+		PoolPut(pBlock);
+	}
+}
+
+/*
+ * Grow the output file by szOutput bytes and map the new region. mmap
+ * needs a page-aligned offset, so the window may start a little early.
+ */
+void MapOutput(size_t szOutput)
+{
+	off_t szPage = sysconf(_SC_PAGESIZE);
+	off_t base = mOutOffset / szPage * szPage;
+
+	if (szOutput == 0)
+	{
+		mpOutMap = NULL;
+		return;
+	}
+	if (ftruncate(mOutFd, mOutOffset + szOutput) != 0)
+	{
+		printf("punzip: cannot resize output\n");
+		exit(1);
+	}
+	mOutMapSkew = mOutOffset - base;
+	mszOutMap = mOutMapSkew + szOutput;
+	mpOutMap = Mmap(NULL, mszOutMap, PROT_READ | PROT_WRITE, MAP_SHARED, 
+					mOutFd, base);
+}
+
+void UnmapOutput()
+{
+	if (mpOutMap != NULL)
+	{
+		Munmap(mpOutMap, mszOutMap);
+	}
+}
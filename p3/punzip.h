@@ -0,0 +1,21 @@
+#include <stdint.h>
+#include <sys/types.h>
+typedef struct __zrange_t zrange_t;
+typedef struct __zipindex_t zipindex_t;
+typedef struct __block_t block_t;
+typedef unsigned char ubyte_t;
+
+int ParseArgs(int argc, char** argv);
+uint64_t ParseOffset(char* szValue);
+void UnzipFile(char* szName);
+void IndexRaw(char* szName);
+void IndexFramed(char* szName);
+void IndexVarint(char* szName);
+void RunWorkers(void* (*fnWork)(void*));
+void* SumRanges(void* arg);
+void* ExpandBlocks(void* arg);
+void ExpandRange(zipindex_t* pIndex, uint64_t start, uint64_t end, 
+					ubyte_t* pOut);
+void WriteBlocks();
+void MapOutput(size_t szOutput);
+void UnmapOutput();
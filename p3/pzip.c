@@ -1,21 +1,38 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
-#include "node.h"
-#include "hashmap.h"
+#include <sys/uio.h>
+#include <unistd.h>
+#include "io.h"
+#include "numa.h"
+#include "pool.h"
 #include "pzip.h"
+#include "ring.h"
+#include "rle.h"
+#include "runs.h"
+#include "stats.h"
 #include "utilities.h"
 
-#define szTextBuffer (4096)
-#define szRleBytes (5)
+#define szDefaultChunk (4 << 20)
+#define szMinChunk (64 << 10)
 #define szZipBuffer (512)
-#define szHashMap (16)
-#define Shift (8)
+#define RingSlotsPerThread (4)
+#define MinRingSlots (8)
+/* chunks ReadStream may read ahead of the workers, per worker */
+#define StreamSlotsPerThread (2)
 #define MaxOpenFiles (8)
-#define szWriteBuffer (512)
+#define IovBatch (64)
+#define szWriteBatch (1 << 20)
+/* rounds of chunk claims that MADV_WILLNEED runs ahead of the workers */
+#define PrefetchRounds (2)
+#define szHugePage (2 << 20)
+/* appended to an input's name to name its archive with --each */
+#define OutputSuffix ".z"
+#define Usage "pzip: file1 [file2 ...]\n"
 
 typedef unsigned char ubyte_t;
 
@@ -25,322 +42,1499 @@ typedef struct __zip_t
 	unsigned char c;
 } zip_t;
 
+/*
+ * Chunks WriteZip has taken from the ring but not yet written. The last
+ * record of the newest chunk is always held back so the first run of the
+ * next chunk can be merged into it in place.
+ */
+typedef struct __writer_t
+{
+	int fd;
+	struct iovec pIov[IovBatch];
+	zipstream_t* pChunks[IovBatch];
+	int nPending;
+	size_t szPending;
+	/* held-back record, inside pChunks[nPending - 1]; NULL if none */
+	ubyte_t* pLast;
+	/* length of a held-back record in the output format */
+	size_t szLast;
+	/* --format=framed: bytes handed to writev so far and the frame index */
+	uint64_t szWritten;
+	uint64_t szUncompressed;
+	size_t nFrames;
+	size_t nIndexCapacity;
+	ubyte_t* pIndex;
+	/* the format header, if any, while it is pending */
+	ubyte_t pFormat[szRleBytes];
+} writer_t;
+
 typedef struct __args_t
 {
 	int argc;
 	char** argv;
 } args_t;
 
-typedef struct __filestat_t
+/* an input file, mapped once and shared by every chunk cut from it */
+typedef struct __mappedfile_t
 {
-	int index;
 	int fd;
 	size_t size;
+	ubyte_t* text;
+	/* chunks not yet compressed; the last one unmaps the file */
+	atomic_int nRefs;
+} mappedfile_t;
+
+/* a slice of one input file; the unit of work claimed by CompressText */
+typedef struct __chunk_t
+{
+	size_t index;
+	mappedfile_t* pFile;
 	off_t offset;
-} filestat_t;
+	size_t size;
+	/* set on the final chunk of all input */
+	int bLast;
+} chunk_t;
+
+/* a chunk of a streamed input, read by ReadStream into the text after it */
+typedef struct __streamchunk_t
+{
+	chunk_t chunk;
+	ubyte_t text[];
+} streamchunk_t;
 
 typedef struct __zipstream_t
 {
 	int valid;
-	int index;
-	int fd;
+	size_t index;
+	mappedfile_t* pFile;
 	size_t size;
-	char* text;
-	/* number of run-length endcodings packed */
+	ubyte_t* text;
+	/* bytes of input the stream encodes, and whether they end all input */
+	size_t textsize;
+	int bLast;
+	/* bytes of encoded output in stream, and the records or tokens in it */
 	size_t streamsize;
+	size_t nruns;
+	/* kept, with its capacity in bytes, when the zipstream_t is recycled */
 	ubyte_t* stream;
+	size_t streamcapacity;
+	/* the run ending stream, which the next chunk may merge into; NULL if
+	   the stream is empty or, for varint, ends in a literal */
+	ubyte_t* pLastRun;
+	/* NUMA node the stream was encoded on */
+	int node;
+	/* --format=framed: the frame header written ahead of stream */
+	ubyte_t header[szFrameHeader];
 } zipstream_t;
 
+typedef struct __worker_t
+{
+	pthread_t thread;
+	/* recycles this worker's zipstream_t and stream buffers */
+	pool_t* pPool;
+	/* --numa: the node the worker is pinned to and claims chunks from */
+	int node;
+	workerstats_t* pStats;
+} worker_t;
+
 args_t mArgs;
 
 int mVerbose = 0;
 
-filestat_t mCurrentFile;
-pthread_mutex_t mCurrentFileLock;
+/* number of CompressText worker threads */
+int mnThreads = 0;
+worker_t* mpWorkers;
+
+/* bytes of input per chunk; 0 picks one from the input in ChunkSizeFor */
+size_t mszChunk = 0;
+
+/* count runs before encoding so each stream buffer is sized exactly once */
+int mTwoPass = 0;
+
+/* FormatRaw, FormatFramed or FormatVarint, from --format */
+int mFormat = FormatRaw;
+
+/* IoMmap, IoDirect or IoUring, from --io */
+int mIo = IoMmap;
+
+/* madvise the input mappings; cleared by --no-madvise */
+int mAdvise = 1;
 
-hashmap_t* mpZipHash;
+/* pin workers to NUMA nodes and claim chunks per node; set by --numa */
+int mNuma = 0;
+int mnNodes = 1;
+/* chunks per stripe; stripe s of the chunk index belongs to node s % mnNodes */
+size_t mnStripe;
+/* each node's next unclaimed chunk, counted through that node's stripes */
+atomic_size_t mpNodeNext[MaxNodes];
+/*
+ * --stats counters, summarised on stderr at exit; with --stats-interval N
+ * ReportStats also prints a JSON line of totals every N milliseconds.
+ */
+int mStats = 0;
+long mnStatsInterval = 0;
+workerstats_t* mpStats;
+writerstats_t mWriterStats;
+uint64_t mnsStart;
+int mStatsDone = 0;
+pthread_mutex_t mStatsLock;
+pthread_cond_t mStatsCond;
 
-// handle tracking and closing files later
+mappedfile_t* mpFiles;
+
+/*
+ * Set when the only input is a pipe or other non-regular file, including
+ * "-" for such a stdin. ReadStream then cuts it into chunks as it arrives
+ * and hands them to the workers through mpStreamRing, indexed like
+ * mpChunks, in buffers from mpStreamPool; mpChunks stays empty.
+ */
+int mStream = 0;
+ring_t* mpStreamRing;
+pool_t* mpStreamPool;
+
+/* write each input's archive to a file next to it instead of stdout */
+int mEach = 0;
+
+/* every chunk of every input, in output order */
+chunk_t* mpChunks;
+size_t mnChunks;
+/* index of the next unclaimed chunk in mpChunks */
+atomic_size_t mNextChunk;
+
+/* hands compressed chunks from the workers to WriteZip in index order */
+ring_t* mpZipRing;
+
+/* cap on compressed bytes published but not yet written; 0 for no cap */
+size_t mszMaxInflight = 0;
+size_t mszInflight = 0;
+/* index of the chunk WriteZip is waiting for; never held back by the cap */
+size_t mnWriteIndex = 0;
+pthread_mutex_t mInflightLock;
+pthread_cond_t mInflightCond;
 
 int main(int argc, char** argv)
 {
-	if (argc < 2)
+	pthread_t writeThread;
+	pthread_t statsThread;
+	pthread_t readThread;
+
+	ParseArgs(argc, argv);
+	mnsStart = NowNs();
+
+	Init();
+
+	mpWorkers = Malloc(sizeof(worker_t) * mnThreads);
+	mpStats = aligned_alloc(_Alignof(workerstats_t), 
+							sizeof(workerstats_t) * mnThreads);
+	if (mpStats == NULL)
 	{
-		printf("pzip: file1 [file2 ...]\n");
+		printf("pzip: unable to allocate statistics\n");
 		exit(1);
 	}
+	memset(mpStats, 0, sizeof(workerstats_t) * mnThreads);
+	if (mnStatsInterval > 0)
+	{
+		PthreadMutexInit(&mStatsLock);
+		PthreadCondInit(&mStatsCond);
+		PthreadCreate(&statsThread, NULL, ReportStats, NULL);
+	}
 
-	if (strcmp(argv[1], "-v") == 0)
+	for (int i = 0; i < mnThreads; i++)
+	{
+		mpWorkers[i].pPool = InitPool(sizeof(zipstream_t));
+		mpWorkers[i].node = i * mnNodes / mnThreads;
+		mpWorkers[i].pStats = &mpStats[i];
+		PthreadCreate(&mpWorkers[i].thread, NULL, CompressText, 
+						&mpWorkers[i]);
+	}
+	PthreadCreate(&writeThread, NULL, WriteZip, NULL);
+	if (mStream)
 	{
-		mVerbose = 1;
+		PthreadCreate(&readThread, NULL, ReadStream, &mpFiles[0]);
+	}
+
+	for (int i = 0; i < mnThreads; i++)
+	{
+		PthreadJoin(mpWorkers[i].thread, NULL);
+	}
+	PthreadJoin(writeThread, NULL);
+	if (mStream)
+	{
+		PthreadJoin(readThread, NULL);
+		DestroyPool(mpStreamPool, NULL);
+		DestroyRing(mpStreamRing);
+	}
+	if (mnStatsInterval > 0)
+	{
+		PthreadMutexLock(&mStatsLock);
+		mStatsDone = 1;
+		PthreadCondSignal(&mStatsCond);
+		PthreadMutexUnlock(&mStatsLock);
+		PthreadJoin(statsThread, NULL);
+	}
+	if (mStats)
+	{
+		PrintStats(stderr, mpStats, mnThreads, &mWriterStats, 
+					NowNs() - mnsStart);
+	}
+	free(mpStats);
+
+	for (int i = 0; i < mnThreads; i++)
+	{
+		DestroyPool(mpWorkers[i].pPool, DestroyZipStream);
+	}
+	free(mpWorkers);
+
+	DestroyRing(mpZipRing);
+	free(mpChunks);
+	free(mpFiles);
+
+	return 0;
+}
+
+/*
+ * Consume leading options: -v for verbose output, -j N for the number of
+ * compression threads (default: number of online CPUs), --chunk-size N
+ * for the bytes of input compressed per work item and --max-inflight-bytes N
+ * to cap compressed output waiting on the writer. Sizes take K, M and G
+ * suffixes. --two-pass sizes each chunk's output buffer from a run count
+ * instead of growing it. --format=framed writes the seekable framed format
+ * described in rle.h, one frame per chunk, and --format=varint the compact
+ * varint format. --io=direct reads chunks with O_DIRECT instead of mapping
+ * the inputs and --io=uring reads them ahead through io_uring.
+ * --no-madvise leaves out the access hints given for mapped inputs.
+ * --numa spreads workers over the NUMA nodes, pinned, and has each node
+ * compress its own stripes of consecutive chunks. --stats prints pipeline
+ * statistics to stderr at exit and --stats-interval N, in milliseconds,
+ * prints running totals as JSON lines while compressing. An input of "-"
+ * reads stdin, which, like any pipe given as an input, is compressed as it
+ * arrives and must then be the only input. --each writes every input's
+ * archive to its name plus ".z", sharing the workers between the inputs.
+ */
+void ParseArgs(int argc, char** argv)
+{
+	char* pEnd;
+	char* szValue;
+
+	argc--;
+	argv++;
+	while (argc > 0 && (*argv)[0] == '-')
+	{
+		if (strcmp(*argv, "-v") == 0)
+		{
+			mVerbose = 1;
+		}
+		else if (strcmp(*argv, "--two-pass") == 0)
+		{
+			mTwoPass = 1;
+		}
+		else if (strcmp(*argv, "--no-madvise") == 0)
+		{
+			mAdvise = 0;
+		}
+		else if (strcmp(*argv, "--each") == 0)
+		{
+			mEach = 1;
+		}
+		else if (strcmp(*argv, "--numa") == 0)
+		{
+			mNuma = 1;
+		}
+		else if (strcmp(*argv, "--stats") == 0)
+		{
+			mStats = 1;
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "--stats-interval")) 
+					!= NULL)
+		{
+			mnStatsInterval = strtol(szValue, &pEnd, 10);
+			if (*pEnd != '\0' || mnStatsInterval < 1)
+			{
+				printf("pzip: invalid stats interval '%s'\n", szValue);
+				exit(1);
+			}
+			mStats = 1;
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "-j")) != NULL)
+		{
+			mnThreads = strtol(szValue, &pEnd, 10);
+			if (*pEnd != '\0' || mnThreads < 1)
+			{
+				printf("pzip: invalid thread count '%s'\n", szValue);
+				exit(1);
+			}
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "--chunk-size")) != NULL)
+		{
+			mszChunk = ParseSize(szValue);
+			if (mszChunk == 0)
+			{
+				printf("pzip: invalid chunk size '%s'\n", szValue);
+				exit(1);
+			}
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "--format")) != NULL)
+		{
+			if (strcmp(szValue, "raw") == 0)
+			{
+				mFormat = FormatRaw;
+			}
+			else if (strcmp(szValue, "framed") == 0)
+			{
+				mFormat = FormatFramed;
+			}
+			else if (strcmp(szValue, "varint") == 0)
+			{
+				mFormat = FormatVarint;
+			}
+			else
+			{
+				printf("pzip: unknown format '%s'\n", szValue);
+				exit(1);
+			}
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "--io")) != NULL)
+		{
+			if (strcmp(szValue, "mmap") == 0)
+			{
+				mIo = IoMmap;
+			}
+			else if (strcmp(szValue, "direct") == 0)
+			{
+				mIo = IoDirect;
+			}
+			else if (strcmp(szValue, "uring") == 0)
+			{
+				mIo = IoUring;
+			}
+			else
+			{
+				printf("pzip: unknown io mode '%s'\n", szValue);
+				exit(1);
+			}
+		}
+		else if ((szValue = OptionValue(&argc, &argv, "--max-inflight-bytes"))
+					!= NULL)
+		{
+			mszMaxInflight = ParseSize(szValue);
+			if (mszMaxInflight == 0)
+			{
+				printf("pzip: invalid inflight limit '%s'\n", szValue);
+				exit(1);
+			}
+		}
+		else
+		{
+			break;
+		}
 		argc--;
 		argv++;
 	}
 
+	if (argc < 1)
+	{
+		printf(Usage);
+		exit(1);
+	}
+
+	if (mnThreads == 0)
+	{
+		mnThreads = sysconf(_SC_NPROCESSORS_ONLN);
+		if (mnThreads < 1)
+		{
+			mnThreads = 1;
+		}
+	}
+
 	mArgs.argc = argc;
 	mArgs.argv = argv;
+}
 
-	Init();
+/*
+ * Match an option taking a value, given either as "name value" or
+ * "name=value". On a match of the first form argv is advanced past the name.
+ */
+char* OptionValue(int* pArgc, char*** pArgv, char* szName)
+{
+	char* szArg = **pArgv;
+	size_t nName = strlen(szName);
 
-	pthread_t fileThread1;
-	pthread_t fileThread2;
-	pthread_t writeThread;
+	if (strncmp(szArg, szName, nName) != 0)
+	{
+		return NULL;
+	}
+	if (szArg[nName] == '=')
+	{
+		return szArg + nName + 1;
+	}
+	if (szArg[nName] == '\0' && *pArgc > 1)
+	{
+		(*pArgc)--;
+		(*pArgv)++;
+		return **pArgv;
+	}
 
-	PthreadCreate(&fileThread2, NULL, CompressText, NULL);
-	PthreadCreate(&fileThread1, NULL, CompressText, NULL);
-	PthreadCreate(&writeThread, NULL, WriteZip, NULL);
+	return NULL;
+}
 
-	PthreadJoin(fileThread1, NULL);	
-	PthreadJoin(fileThread2, NULL);
-	PthreadJoin(writeThread, NULL);
+/*
+ * Parse a byte count with an optional K, M or G suffix. Returns 0 if the
+ * string is not a positive size.
+ */
+size_t ParseSize(char* szValue)
+{
+	char* pEnd;
+	unsigned long long n;
 
-	DestroyData(mpZipHash);
-	DestroyHashMap(mpZipHash);
+	if (szValue[0] < '0' || szValue[0] > '9')
+	{
+		return 0;
+	}
+	n = strtoull(szValue, &pEnd, 10);
+	switch (*pEnd)
+	{
+		case 'g': case 'G': n <<= 10; // fall through
+		case 'm': case 'M': n <<= 10; // fall through
+		case 'k': case 'K': n <<= 10; pEnd++; // fall through
+		default: break;
+	}
+	if (*pEnd != '\0')
+	{
+		return 0;
+	}
 
-	return 0;
+	return n;
 }
 
+/*
+ * Open and stat every input up front and cut the inputs into the global
+ * chunk index that CompressText workers claim from.
+ */
 void Init()
 {
-	mCurrentFile.size = 0;
-	mCurrentFile.offset = 0;
-	PthreadMutexInit(&mCurrentFileLock);
+	size_t szTotal = 0;
+	size_t nFileChunks;
+	size_t nChunk = 0;
+	size_t nSlots;
+	chunk_t* pChunk;
 
-	mpZipHash = InitHashMap(szHashMap);
+	mpFiles = Malloc(sizeof(mappedfile_t) * mArgs.argc);
+	for (int i = 0; i < mArgs.argc; i++)
+	{
+		OpenFile(mArgs.argv[i], &mpFiles[i]);
+		szTotal += mpFiles[i].size;
+	}
+	if (mszChunk == 0)
+	{
+		// a stream's size is not known up front
+		mszChunk = mStream ? szDefaultChunk : ChunkSizeFor(szTotal);
+	}
+	if (mIo != IoMmap)
+	{
+		// chunk offsets must suit O_DIRECT
+		mszChunk = (mszChunk + szIoAlign - 1) / szIoAlign * szIoAlign;
+	}
+
+	mnChunks = 0;
+	for (int i = 0; i < mArgs.argc; i++)
+	{
+		nFileChunks = (mpFiles[i].size + mszChunk - 1) / mszChunk;
+		atomic_init(&mpFiles[i].nRefs, nFileChunks);
+		mnChunks += nFileChunks;
+	}
+	mpChunks = Malloc(sizeof(chunk_t) * (mnChunks > 0 ? mnChunks : 1));
+	for (int i = 0; i < mArgs.argc; i++)
+	{
+		for (off_t offset = 0; offset < mpFiles[i].size; offset += mszChunk)
+		{
+			pChunk = &mpChunks[nChunk];
+			pChunk->index = nChunk++;
+			pChunk->pFile = &mpFiles[i];
+			pChunk->offset = offset;
+			pChunk->size = mpFiles[i].size - offset;
+			if (pChunk->size > mszChunk)
+			{
+				pChunk->size = mszChunk;
+			}
+			// with --each, the last chunk of every input ends an archive
+			if (mEach)
+			{
+				pChunk->bLast = offset + mszChunk >= mpFiles[i].size;
+			}
+			else
+			{
+				pChunk->bLast = nChunk == mnChunks;
+			}
+		}
+	}
+	atomic_init(&mNextChunk, 0);
+	if (mNuma)
+	{
+		// a node without workers would never claim its stripes first
+		mnNodes = InitNuma();
+		if (mnNodes > mnThreads)
+		{
+			mnNodes = mnThreads;
+		}
+		mnStripe = mnThreads / mnNodes;
+		for (int i = 0; i < mnNodes; i++)
+		{
+			atomic_init(&mpNodeNext[i], 0);
+		}
+	}
+	for (size_t i = 0; i < PrefetchRounds * mnThreads && i < mnChunks; i++)
+	{
+		AdviseChunk(&mpChunks[i], MADV_WILLNEED);
+	}
+
+	InitRuns();
+
+	PthreadMutexInit(&mInflightLock);
+	PthreadCondInit(&mInflightCond);
+
+	nSlots = RingSlotsPerThread * mnThreads;
+	mpZipRing = InitRing(nSlots > MinRingSlots ? nSlots : MinRingSlots);
+	if (mStream)
+	{
+		mpStreamRing = InitRing(StreamSlotsPerThread * mnThreads);
+		mpStreamPool = InitPool(sizeof(streamchunk_t) + mszChunk);
+	}
 }
 
-void* CompressText()
+void* CompressText(void* arg)
 {
-	int rc;
-	filestat_t fs;
+	worker_t* pWorker = arg;
+	workerstats_t* pStats = pWorker->pStats;
+	chunk_t* pChunk;
 	zipstream_t* zs;
+	reader_t* pReader = NULL;
+	ubyte_t* pText;
+	uint64_t nsClaim;
+	uint64_t nsZip;
+	uint64_t nsPut;
 
-	while (1)
+	// pin first so buffers are first touched on the worker's node
+	if (mNuma)
 	{
-		rc = GetNextPage(&fs);
-		zs = Malloc(sizeof(zipstream_t));
-		if (rc != 0)
-		{
-			zs->valid = 1;
-			zs->index = fs.index;
-			zs->stream = NULL;
-			PutZip(zs);
-			return NULL;
-		}
-		zs->index = fs.index;
-		zs->fd = fs.fd;
-		zs->size = fs.size;
-		zs->text = Mmap(NULL, fs.size, PROT_READ, 
-						MAP_PRIVATE, fs.fd, fs.offset);
+		PinToNode(pWorker->node);
+	}
+	if (mIo != IoMmap && !mStream)
+	{
+		pReader = InitReader(mIo, mszChunk);
+	}
+
+	nsClaim = StatsNow();
+	while ((pChunk = GetChunkText(pWorker, pReader, &pText)) != NULL)
+	{
+		nsZip = StatsNow();
+		StatAdd(&pStats->nsClaim, nsZip - nsClaim);
+		zs = PoolGet(pWorker->pPool);
+		zs->index = pChunk->index;
+		zs->pFile = pChunk->pFile;
+		zs->size = pChunk->size;
+		zs->text = pText;
+		zs->textsize = pChunk->size;
+		zs->bLast = pChunk->bLast;
 		zs->valid = 1;
 		ZipPage(zs);
+		zs->node = mStats ? CurrentNode() : 0;
+		if (pReader == NULL)
+		{
+			AdviseChunk(pChunk, MADV_DONTNEED);
+		}
+		ReleaseChunk(pChunk);
+		zs->pFile = NULL;
+
+		// zs belongs to the writer once published
+		nsPut = StatsNow();
+		StatAdd(&pStats->nChunks, 1);
+		StatAdd(&pStats->szIn, zs->textsize);
+		StatAdd(&pStats->nRuns, zs->nruns);
+		StatAdd(&pStats->szOut, zs->streamsize);
 		PutZip(zs);
+
+		nsClaim = StatsNow();
+		StatAdd(&pStats->nsZip, nsPut - nsZip);
+		StatAdd(&pStats->nsPut, nsClaim - nsPut);
 	}
+
+	if (pReader != NULL)
+	{
+		DestroyReader(pReader);
+	}
+
+	return NULL;
+}
+
+/*
+ * Claim the next chunk and find its text: its slice of the input mapping,
+ * with a reader, the buffer the chunk was read into, or for a streamed
+ * input, the buffer ReadStream filled. A reader keeps
+ * reads for later claims in flight but returns chunks in claim order, so
+ * a worker blocked in PutZip never holds back an earlier chunk. For the
+ * same reason it only takes another node's chunks when nothing is queued:
+ * those may come before the chunks it holds.
+ */
+chunk_t* GetChunkText(worker_t* pWorker, reader_t* pReader, ubyte_t** ppText)
+{
+	chunk_t* pChunk;
+
+	if (mStream)
+	{
+		pChunk = RingGet(mpStreamRing, atomic_fetch_add(&mNextChunk, 1));
+		if (pChunk != NULL)
+		{
+			*ppText = ((streamchunk_t*) pChunk)->text;
+		}
+		return pChunk;
+	}
+	if (pReader == NULL)
+	{
+		pChunk = GetNextChunk(pWorker, 1);
+		if (pChunk != NULL)
+		{
+			*ppText = pChunk->pFile->text + pChunk->offset;
+			if (pChunk->index + PrefetchRounds * mnThreads < mnChunks)
+			{
+				AdviseChunk(&mpChunks[pChunk->index + PrefetchRounds 
+										* mnThreads], MADV_WILLNEED);
+			}
+		}
+		return pChunk;
+	}
+
+	while (!ReaderFull(pReader) 
+			&& (pChunk = GetNextChunk(pWorker, ReaderEmpty(pReader))) != NULL)
+	{
+		ReaderSubmit(pReader, pChunk->pFile->fd, pChunk->offset, 
+						pChunk->size, pChunk);
+	}
+	*ppText = ReaderNext(pReader, (void**) &pChunk);
+
+	return *ppText != NULL ? pChunk : NULL;
+}
+
+/*
+ * Claim the next chunk of input, or NULL once every chunk has been claimed.
+ * With --numa a worker claims from its node's stripes and, if bSteal is
+ * set, from the other nodes' once its own are gone.
+ */
+chunk_t* GetNextChunk(worker_t* pWorker, int bSteal)
+{
+	size_t nChunk;
+	chunk_t* pChunk;
+
+	if (mNuma)
+	{
+		pChunk = ClaimNodeChunk(pWorker->node);
+		for (int i = 1; pChunk == NULL && bSteal && i < mnNodes; i++)
+		{
+			pChunk = ClaimNodeChunk((pWorker->node + i) % mnNodes);
+		}
+		return pChunk;
+	}
+
+	nChunk = atomic_fetch_add(&mNextChunk, 1);
+	if (nChunk >= mnChunks)
+	{
+		return NULL;
+	}
+
+	return &mpChunks[nChunk];
+}
+
+/*
+ * Claim the next chunk of node nNode's stripes. A node's claims rise
+ * through the chunk index, like the single counter's do.
+ */
+chunk_t* ClaimNodeChunk(int nNode)
+{
+	size_t n = atomic_fetch_add(&mpNodeNext[nNode], 1);
+	size_t nChunk = (n / mnStripe * mnNodes + nNode) * mnStripe + n % mnStripe;
+
+	if (nChunk >= mnChunks)
+	{
+		return NULL;
+	}
+
+	return &mpChunks[nChunk];
 }
 
-int GetNextPage(filestat_t* fs)
+/*
+ * Cut a streamed input into chunks as it arrives and publish them to
+ * mpStreamRing in order. Every chunk but the last is filled to mszChunk,
+ * so chunks fall where they would in a file of the same bytes, and each
+ * is held until the next read shows whether it is the last. At the end
+ * every worker is sent a NULL chunk and the writer a NULL stream.
+ */
+void* ReadStream(void* arg)
 {
-	filestat_t* current;
+	mappedfile_t* pFile = arg;
+	streamchunk_t* pChunk = PoolGet(mpStreamPool);
+	streamchunk_t* pNext;
+	size_t index = 0;
+	size_t szRead;
 
-	PthreadMutexLock(&mCurrentFileLock);
-	current = &mCurrentFile;
-	fs->index = (current->index)++;
-	if (current->size == current->offset)
-	{	
-		if (--mArgs.argc > 0)
+	szRead = Read(pFile->fd, pChunk->text, mszChunk);
+	while (szRead > 0)
+	{
+		pChunk->chunk.index = index;
+		pChunk->chunk.pFile = pFile;
+		pChunk->chunk.offset = index * mszChunk;
+		pChunk->chunk.size = szRead;
+		pNext = PoolGet(mpStreamPool);
+		// a short read means the input has ended
+		if (szRead == mszChunk)
 		{
-			OpenNextFile(current);
+			szRead = Read(pFile->fd, pNext->text, mszChunk);
 		}
 		else
 		{
-			// done reading files
-			PthreadMutexUnlock(&mCurrentFileLock);
-			return -1;
+			szRead = 0;
 		}
+		pChunk->chunk.bLast = szRead == 0;
+		RingPut(mpStreamRing, index++, pChunk);
+		pChunk = pNext;
+	}
+	PoolPut(pChunk);
+	Close(pFile->fd);
+
+	for (int i = 0; i < mnThreads; i++)
+	{
+		RingPut(mpStreamRing, index + i, NULL);
 	}
-	fs->fd = current->fd;
-	fs->offset = current->offset;
-	if (current->size - current->offset > szTextBuffer)
+	RingPut(mpZipRing, index, NULL);
+
+	return NULL;
+}
+
+/*
+ * Open, stat and map an input file, "-" being stdin. Empty files are
+ * closed straight away and left with a NULL mapping, as are all inputs with
+ * --io=direct or --io=uring, which read chunks from the descriptor
+ * instead. A pipe is left open and unmapped for ReadStream.
+ */
+void OpenFile(char* szName, mappedfile_t* pFile)
+{
+	struct stat s;
+
+	if (strcmp(szName, "-") == 0)
 	{
-		fs->size = szTextBuffer;
+		pFile->fd = STDIN_FILENO;
 	}
 	else
 	{
-		fs->size = current->size - current->offset;
+		pFile->fd = OpenInput(szName, mIo);
+	}
+	Fstat(pFile->fd, &s);
+	pFile->size = s.st_size;
+	pFile->text = NULL;
+	if (!S_ISREG(s.st_mode))
+	{
+		if (mArgs.argc > 1)
+		{
+			printf("pzip: %s: a pipe must be the only input\n", szName);
+			exit(1);
+		}
+		if (mEach)
+		{
+			printf("pzip: %s: --each needs regular files\n", szName);
+			exit(1);
+		}
+		mStream = 1;
+		pFile->size = 0;
+		return;
+	}
+	if (pFile->size == 0)
+	{
+		Close(pFile->fd);
+		return;
+	}
+	if (mIo != IoMmap)
+	{
+		return;
 	}
-	current->offset += fs->size;
-	PthreadMutexUnlock(&mCurrentFileLock);
 
-	return 0;
+	pFile->text = Mmap(NULL, pFile->size, PROT_READ, MAP_PRIVATE, 
+						pFile->fd, 0);
+	// the mapping outlives the descriptor, so many inputs hold few open
+	Close(pFile->fd);
+	pFile->fd = -1;
+	if (mAdvise)
+	{
+		// hints only; filesystems without huge page support ignore them
+		madvise(pFile->text, pFile->size, MADV_SEQUENTIAL);
+		if (pFile->size >= szHugePage)
+		{
+			madvise(pFile->text, pFile->size, MADV_HUGEPAGE);
+		}
+	}
 }
 
-void OpenNextFile(filestat_t* fs)
+/*
+ * Pass a madvise hint for a chunk's pages of its file mapping. WILLNEED
+ * starts readahead over every page the chunk touches; DONTNEED, given once
+ * the chunk is compressed, drops only pages wholly inside it, as the
+ * neighbouring chunks may still be in use.
+ */
+void AdviseChunk(chunk_t* pChunk, int advice)
 {
-	struct stat s;
+	size_t szPage = sysconf(_SC_PAGESIZE);
+	size_t start = pChunk->offset;
+	size_t end = pChunk->offset + pChunk->size;
 
-	fs->fd = Open(*(++mArgs.argv), O_RDONLY);
-	Fstat(fs->fd, &s);
-	fs->size = s.st_size;
-	fs->offset = 0;
+	if (!mAdvise || pChunk->pFile->text == NULL)
+	{
+		return;
+	}
+	if (advice == MADV_DONTNEED)
+	{
+		start = (start + szPage - 1) / szPage * szPage;
+		if (end != pChunk->pFile->size)
+		{
+			end = end / szPage * szPage;
+		}
+	}
+	else
+	{
+		start = start / szPage * szPage;
+	}
+	if (end > start)
+	{
+		madvise(pChunk->pFile->text + start, end - start, advice);
+	}
+}
+
+/*
+ * Without --chunk-size, inputs too small to give every worker a default
+ * chunk are cut into one page-aligned piece per worker instead.
+ */
+size_t ChunkSizeFor(size_t szInput)
+{
+	size_t szChunk;
+	size_t szPage = sysconf(_SC_PAGESIZE);
+
+	szChunk = szInput / mnThreads;
+	szChunk = (szChunk + szPage - 1) / szPage * szPage;
+	if (szChunk > szDefaultChunk)
+	{
+		return szDefaultChunk;
+	}
+	if (szChunk < szMinChunk)
+	{
+		return szMinChunk;
+	}
+
+	return szChunk;
+}
+
+/*
+ * Finish with a compressed chunk's text: a streamed chunk's buffer goes
+ * back to ReadStream, other chunks drop their reference to their file.
+ */
+void ReleaseChunk(chunk_t* pChunk)
+{
+	if (mStream)
+	{
+		PoolPut(pChunk);
+	}
+	else
+	{
+		ReleaseFile(pChunk->pFile);
+	}
+}
+
+/*
+ * Drop a chunk's reference to an input, unmapping it or closing it with
+ * the last.
+ */
+void ReleaseFile(mappedfile_t* pFile)
+{
+	if (atomic_fetch_sub(&pFile->nRefs, 1) == 1)
+	{
+		if (pFile->text != NULL)
+		{
+			Munmap(pFile->text, pFile->size);
+		}
+		if (pFile->fd >= 0)
+		{
+			Close(pFile->fd);
+		}
+	}
 }
 
 void ZipPage(zipstream_t* fs)
 {
-	char* pChar = fs->text;
-	size_t szBuffer = szRleBytes * szZipBuffer;
-	ubyte_t* pBuffer = Malloc(sizeof(ubyte_t) * szBuffer);
-	ubyte_t* pCurrentByte = pBuffer;
+	ubyte_t* pChar = fs->text;
+	ubyte_t* pEnd = fs->text + fs->size;
+	ubyte_t* pRunEnd;
+	size_t szBuffer = fs->streamcapacity;
+	ubyte_t* pBuffer = fs->stream;
+	ubyte_t* pCurrentByte;
 	zip_t zip;
 	size_t szStream = 0;
+	size_t szExact;
+	size_t szRun;
 
-	while (pChar < fs->text + fs->size)
+	if (mFormat == FormatVarint)
 	{
-		zip.count = 0;
-		zip.c = *pChar;
-		while (pChar < fs->text + fs->size && zip.c == *pChar)
+		ZipPageVarint(fs);
+		return;
+	}
+
+	// reuse the buffer a recycled zipstream_t brings along
+	if (mTwoPass)
+	{
+		// plus room for runs split at MaxCount
+		szExact = szRleBytes * (CountRuns(pChar, pEnd) + fs->size / MaxCount);
+		if (pBuffer == NULL || szExact > szBuffer)
 		{
-			zip.count++;
-			pChar++;
+			free(pBuffer);
+			szBuffer = szExact;
+			pBuffer = Malloc(sizeof(ubyte_t) * szBuffer);
 		}
-		for (int i = 0; i < sizeof(int); i++)
+	}
+	else if (pBuffer == NULL)
+	{
+		szBuffer = szRleBytes * szZipBuffer;
+		pBuffer = Malloc(sizeof(ubyte_t) * szBuffer);
+	}
+	pCurrentByte = pBuffer;
+
+	while (pChar < pEnd)
+	{
+		zip.c = *pChar;
+		pRunEnd = FindRunEnd(pChar, pEnd);
+		szRun = pRunEnd - pChar;
+		pChar = pRunEnd;
+		// runs too long for one count take several records
+		do
 		{
-			*pCurrentByte = zip.count >> (i * Shift);
+			zip.count = szRun < MaxCount ? szRun : MaxCount;
+			szRun -= zip.count;
+			for (int i = 0; i < sizeof(int); i++)
+			{
+				*pCurrentByte = zip.count >> (i * Shift);
+				pCurrentByte++;
+			}
+			*pCurrentByte = zip.c;
 			pCurrentByte++;
+			szStream++;
+			if (!mTwoPass && szRleBytes * szStream >= szBuffer)
+			{
+				szBuffer *= 2;
+				pBuffer = Realloc(pBuffer, sizeof(ubyte_t) * szBuffer);
+				pCurrentByte = pBuffer + szRleBytes * szStream;
+			}
+		} while (szRun > 0);
+	}
+
+	fs->stream = pBuffer;
+	fs->streamcapacity = szBuffer;
+	fs->streamsize = szRleBytes * szStream;
+	fs->nruns = szStream;
+	fs->pLastRun = szStream > 0 ? pCurrentByte - szRleBytes : NULL;
+	fs->text = NULL;
+	fs->size = 0;
+}
+
+/*
+ * Encode a chunk in the varint format. A stream can never be longer than
+ * the text plus a literal header byte per 64 literal bytes and the padded
+ * final run, so the buffer is sized for that up front.
+ */
+void ZipPageVarint(zipstream_t* fs)
+{
+	ubyte_t* pChar = fs->text;
+	ubyte_t* pEnd = fs->text + fs->size;
+	ubyte_t* pRunEnd;
+	ubyte_t* pLiteral = NULL;
+	ubyte_t* pOut;
+	size_t szBuffer = fs->size + fs->size / 64 + 2 * szVarintMax;
+	uint64_t count;
+	size_t nTokens = 0;
+
+	if (fs->stream == NULL || fs->streamcapacity < szBuffer)
+	{
+		free(fs->stream);
+		fs->stream = Malloc(sizeof(ubyte_t) * szBuffer);
+		fs->streamcapacity = szBuffer;
+	}
+	pOut = fs->stream;
+	fs->pLastRun = NULL;
+
+	while (pChar < pEnd)
+	{
+		pRunEnd = FindRunEnd(pChar, pEnd);
+		count = pRunEnd - pChar;
+		if (count < MinVarintRun)
+		{
+			if (pLiteral == NULL)
+			{
+				pLiteral = pChar;
+			}
+			pChar = pRunEnd;
+			continue;
+		}
+
+		if (pLiteral != NULL)
+		{
+			pOut = PackLiteral(pOut, pLiteral, pChar);
+			pLiteral = NULL;
+			nTokens++;
+		}
+		if (pRunEnd == pEnd && !fs->bLast)
+		{
+			// padded so the writer can merge the next chunk's first run
+			fs->pLastRun = pOut;
+			PackVarintWide(pOut, count << 1);
+			pOut += szVarintMax;
 		}
-		*pCurrentByte = zip.c;
-		pCurrentByte++;
-		szStream++;
-		if (szRleBytes * szStream >= szBuffer)
+		else
 		{
-			szBuffer *= 2;
-			pBuffer = Realloc(pBuffer, sizeof(ubyte_t) * szBuffer);
-			pCurrentByte = pBuffer + szRleBytes * szStream;
+			pOut += PackVarint(pOut, count << 1);
 		}
+		*pOut++ = *pChar;
+		pChar = pRunEnd;
+		nTokens++;
+	}
+	if (pLiteral != NULL)
+	{
+		pOut = PackLiteral(pOut, pLiteral, pEnd);
+		nTokens++;
 	}
 
-	fs->stream = pBuffer;
-	fs->streamsize = szStream;
-	Munmap(fs->text, fs->size);
+	fs->streamsize = pOut - fs->stream;
+	fs->nruns = nTokens;
 	fs->text = NULL;
 	fs->size = 0;
 }
 
+/*
+ * Write a literal token for [pText, pTextEnd) at pOut and return the end
+ * of what was written.
+ */
+ubyte_t* PackLiteral(ubyte_t* pOut, ubyte_t* pText, ubyte_t* pTextEnd)
+{
+	size_t szText = pTextEnd - pText;
+
+	pOut += PackVarint(pOut, ((uint64_t) szText << 1) | 1);
+	memcpy(pOut, pText, szText);
+
+	return pOut + szText;
+}
+
 void PutZip(zipstream_t* zipstream)
 {
-	PutData(mpZipHash, (void*) zipstream, zipstream->index);
+	AcquireInflight(zipstream->streamsize, zipstream->index);
+
+	// the writer may free zipstream as soon as it is in the ring
 	if (mVerbose)
 	{
-		printf("put index: %d (%d)\n",  
-				zipstream->index % szHashMap, 
-				zipstream->index / szHashMap);
+		printf("put index: %zu (%zu)\n",  
+				zipstream->index % mpZipRing->nCapacity, 
+				zipstream->index / mpZipRing->nCapacity);
 		printf("\tstreamsize: 0x%lx\n", zipstream->streamsize);
 	}
+	RingPut(mpZipRing, zipstream->index, (void*) zipstream);
+}
+
+/*
+ * Account for szStream bytes of compressed output about to be published,
+ * blocking while that would exceed --max-inflight-bytes. The chunk the
+ * writer needs next is always let through, as is any chunk when nothing
+ * else is in flight, so an oversized chunk cannot stall the pipeline.
+ * Memory stays bounded by the cap plus one chunk's output per worker.
+ */
+void AcquireInflight(size_t szStream, size_t index)
+{
+	if (mszMaxInflight == 0)
+	{
+		return;
+	}
+
+	PthreadMutexLock(&mInflightLock);
+	while (mszInflight > 0 && mszInflight + szStream > mszMaxInflight
+			&& index != mnWriteIndex)
+	{
+		PthreadCondWait(&mInflightCond, &mInflightLock);
+	}
+	mszInflight += szStream;
+	PthreadMutexUnlock(&mInflightLock);
 }
 
+/*
+ * Called by the writer to return szStream bytes of freed output and note
+ * that it now waits for chunk nWriteIndex.
+ */
+void ReleaseInflight(size_t szStream, size_t nWriteIndex)
+{
+	if (mszMaxInflight == 0)
+	{
+		return;
+	}
+
+	PthreadMutexLock(&mInflightLock);
+	mszInflight -= szStream;
+	mnWriteIndex = nWriteIndex;
+	PthreadCondBroadcast(&mInflightCond);
+	PthreadMutexUnlock(&mInflightLock);
+}
+
+/*
+ * Emit compressed chunks in index order straight from their stream
+ * buffers with writev: to stdout, or with --each, each input's chunks to
+ * its own archive.
+ */
 void* WriteZip()
 {
-	size_t szBuffer = szRleBytes * szWriteBuffer;
-	ubyte_t* pBuffer;
-	ubyte_t* pCurrent;
-	size_t szStream;
+	writer_t writer;
+	size_t index = 0;
+	size_t nChunks;
+
+	writer.nPending = 0;
+	writer.szPending = 0;
+	writer.szLast = mFormat == FormatVarint ? szVarintMax + 1 : szRleBytes;
+	writer.nIndexCapacity = mnChunks > 0 ? mnChunks : 1;
+	writer.pIndex = NULL;
+	if (mFormat == FormatFramed)
+	{
+		writer.pIndex = Malloc(szIndexEntry * writer.nIndexCapacity);
+	}
+
+	if (!mEach)
+	{
+		StartOutput(&writer, STDOUT_FILENO);
+		index = WriteChunks(&writer, 0, mnChunks);
+		FinishOutput(&writer, index);
+	}
+	for (int i = 0; mEach && i < mArgs.argc; i++)
+	{
+		nChunks = (mpFiles[i].size + mszChunk - 1) / mszChunk;
+		StartOutput(&writer, OpenOutput(mArgs.argv[i]));
+		index = WriteChunks(&writer, index, index + nChunks);
+		FinishOutput(&writer, index);
+		Close(writer.fd);
+	}
+	free(writer.pIndex);
+
+	return NULL;
+}
+
+/*
+ * --each: create the archive for input szName, the name with ".z" added.
+ */
+int OpenOutput(char* szName)
+{
+	char* szOutput = Malloc(strlen(szName) + sizeof(OutputSuffix));
+	int fd;
+
+	strcpy(szOutput, szName);
+	strcat(szOutput, OutputSuffix);
+	fd = open(szOutput, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0)
+	{
+		printf("pzip: %s: unable to create\n", szOutput);
+		exit(1);
+	}
+	free(szOutput);
+
+	return fd;
+}
+
+/*
+ * Begin an archive on fd, writing the format header if there is one.
+ */
+void StartOutput(writer_t* pWriter, int fd)
+{
+	pWriter->fd = fd;
+	pWriter->pLast = NULL;
+	pWriter->szWritten = 0;
+	pWriter->szUncompressed = 0;
+	pWriter->nFrames = 0;
+
+	if (mFormat != FormatRaw)
+	{
+		PackCount(pWriter->pFormat, 0);
+		pWriter->pFormat[szRleBytes - 1] = mFormat;
+		AppendZip(pWriter, pWriter->pFormat, szRleBytes, NULL);
+	}
+}
+
+/*
+ * Write the chunks from index nFirst up to nEnd, or for a streamed input,
+ * up to ReadStream's NULL, and return the index after the last. Where a
+ * chunk starts with the same byte the last one ended with, the first
+ * record's count is added to the held-back record and the record is
+ * skipped. Framed output instead gives every chunk its own frame.
+ */
+size_t WriteChunks(writer_t* pWriter, size_t nFirst, size_t nEnd)
+{
 	zipstream_t* pZipStream;
 	ubyte_t* pStream;
-	int index;
-	unsigned int ctPrev;
-	unsigned int ctCur;
-
-	pBuffer = Malloc(sizeof(ubyte_t) * szBuffer);
-	pCurrent = pBuffer;
-	szStream = 0;
+	ubyte_t* pStreamEnd;
+	uint64_t nsWait;
+	size_t index;
 
-	index = 0;
-	while (1)
+	for (index = nFirst; mStream || index < nEnd; index++)
 	{
-		pZipStream = (zipstream_t*) GetData(mpZipHash, index);
+		nsWait = StatsNow();
+		pZipStream = (zipstream_t*) RingGet(mpZipRing, index);
+		StatAdd(&mWriterStats.nsStall, StatsNow() - nsWait);
+		if (pZipStream == NULL)
+		{
+			break;
+		}
+		ReleaseInflight(0, index + 1);
+		if (mStats && pZipStream->node != CurrentNode())
+		{
+			StatAdd(&mWriterStats.szCrossNode, pZipStream->streamsize);
+		}
 
 		if (mVerbose == 1)
 		{
-			printf("GOT INDEX: %d\n", pZipStream->index % szHashMap);
+			printf("GOT INDEX: %zu\n", 
+					pZipStream->index % mpZipRing->nCapacity);
 			PrintStream(pZipStream->stream, pZipStream->streamsize);
 		}
 
 		pStream = pZipStream->stream;
+		pStreamEnd = pStream + pZipStream->streamsize;
 
-		if (pStream == NULL)
+		if (mFormat == FormatFramed)
 		{
-			if (szStream > 0)
+			if (pWriter->nPending + 2 > IovBatch 
+				|| pWriter->szPending >= szWriteBatch)
 			{
-				fwrite(pBuffer, sizeof(ubyte_t), szStream, stdout);
+				FlushZip(pWriter, 0, index + 1);
 			}
-			free(pZipStream);
-			free(pBuffer);
-			break;
+			AppendFrame(pWriter, pZipStream, pZipStream->textsize);
+			continue;
 		}
 
-		//peek previous char
-		if (pCurrent > pBuffer && pStream[4] == *(pCurrent - 1))
+		if (pWriter->pLast != NULL)
 		{
-			// unpack uint
-			pCurrent--;
-			ctPrev = 0;
-			ctCur = 0;
-			for (int i=0; i < sizeof(int); i++)
-			{
-				pCurrent--;
-				ctPrev = (ctPrev << Shift) + *pCurrent;
-				ctCur = (ctCur << Shift) + pStream[4 - i - 1];
-			}
-			//add current count to previous count
-			ctCur += ctPrev;
-			for (int i=0; i < sizeof(int); i++)
-			{
-				*pCurrent = ctCur >> (i * Shift);
-				pCurrent++;
-			}
-			pCurrent++;
-			pStream += 5;
+			pStream += MergeRun(pWriter->pLast, pStream, pStreamEnd);
 		}
 
-		// flush current buffer
-		if (szStream > 0
-				&& szStream + szRleBytes * pZipStream->streamsize > szBuffer)
+		if (pStream == pStreamEnd)
 		{
-			fwrite(pBuffer, sizeof(ubyte_t), szStream, stdout);
-			szStream = 0;
-			pCurrent = pBuffer;
+			// merged away entirely
+			FreeZipStream(pZipStream, index + 1);
+			continue;
 		}
 
-		// dynamic resize buffer
-		if (szRleBytes * pZipStream->streamsize > szBuffer)
+		if (pWriter->nPending == IovBatch || pWriter->szPending >= szWriteBatch)
 		{
-			free(pBuffer);
-			szBuffer = szRleBytes * pZipStream->streamsize;
-			pBuffer = Malloc(sizeof(ubyte_t) * szBuffer);
-			pCurrent = pBuffer;
+			FlushZip(pWriter, 0, index + 1);
 		}
+		AppendZip(pWriter, pStream, pStreamEnd - pStream, pZipStream);
+		pWriter->pLast = pZipStream->pLastRun;
+	}
+
+	return index;
+}
 
-		//copy to buffer
-		while (pStream < pZipStream->stream 
-							+ szRleBytes * pZipStream->streamsize)
+/*
+ * Write out everything pending, the held-back record included, and for
+ * framed output the frame index.
+ */
+void FinishOutput(writer_t* pWriter, size_t nWriteIndex)
+{
+	FlushZip(pWriter, 1, nWriteIndex);
+	if (mFormat == FormatFramed)
+	{
+		WriteIndex(pWriter);
+	}
+}
+
+/*
+ * If the stream at pStream opens with a run of the byte the held-back
+ * run pLast repeats, add its count to pLast and return the length of the
+ * merged record; otherwise return 0. A raw count that would pass MaxCount
+ * fills pLast and leaves the rest in the first record, which is kept.
+ */
+size_t MergeRun(ubyte_t* pLast, ubyte_t* pStream, ubyte_t* pStreamEnd)
+{
+	uint64_t nLast;
+	uint64_t nFirst;
+	size_t szFirst;
+
+	if (mFormat != FormatVarint)
+	{
+		if (pStream[szRleBytes - 1] != pLast[szRleBytes - 1])
 		{
-			*pCurrent = *pStream;
-			pStream++;
-			pCurrent++;
-			szStream++;
+			return 0;
 		}
+		nLast = UnpackCount(pLast);
+		nFirst = UnpackCount(pStream);
+		if (nLast + nFirst > MaxCount)
+		{
+			PackCount(pLast, MaxCount);
+			PackCount(pStream, nLast + nFirst - MaxCount);
+			return 0;
+		}
+		PackCount(pLast, nLast + nFirst);
+		return szRleBytes;
+	}
 
-		free(pZipStream->stream);
-		free(pZipStream);
-		index++;
+	szFirst = UnpackVarint(pStream, pStreamEnd, &nFirst);
+	if ((nFirst & 1) || pStream[szFirst] != pLast[szVarintMax])
+	{
+		return 0;
 	}
+	UnpackVarint(pLast, pLast + szVarintMax, &nLast);
+	PackVarintWide(pLast, nLast + nFirst);
+	return szFirst + 1;
+}
 
-	return NULL;
+/*
+ * Queue szData bytes at pData for the next writev. pZipStream, if not
+ * NULL, is freed once they are written.
+ */
+void AppendZip(writer_t* pWriter, ubyte_t* pData, size_t szData, 
+				zipstream_t* pZipStream)
+{
+	pWriter->pIov[pWriter->nPending].iov_base = pData;
+	pWriter->pIov[pWriter->nPending].iov_len = szData;
+	pWriter->pChunks[pWriter->nPending] = pZipStream;
+	pWriter->nPending++;
+	pWriter->szPending += szData;
+	pWriter->szWritten += szData;
+}
+
+/*
+ * Queue a chunk as a frame of szText uncompressed bytes and add it to the
+ * frame index.
+ */
+void AppendFrame(writer_t* pWriter, zipstream_t* pZipStream, size_t szText)
+{
+	size_t szStream = pZipStream->streamsize;
+	ubyte_t* pEntry;
+
+	if (pWriter->nFrames == pWriter->nIndexCapacity)
+	{
+		// only a stream's index outgrows its first allocation
+		pWriter->nIndexCapacity *= 2;
+		pWriter->pIndex = Realloc(pWriter->pIndex, 
+									szIndexEntry * pWriter->nIndexCapacity);
+	}
+	pEntry = pWriter->pIndex + szIndexEntry * pWriter->nFrames;
+	Pack64(pEntry, pWriter->szWritten);
+	Pack64(pEntry + 8, pWriter->szUncompressed);
+	pWriter->nFrames++;
+	pWriter->szUncompressed += szText;
+
+	Pack64(pZipStream->header, szStream);
+	Pack64(pZipStream->header + 8, szText);
+	AppendZip(pWriter, pZipStream->header, szFrameHeader, NULL);
+	AppendZip(pWriter, pZipStream->stream, szStream, pZipStream);
+}
+
+/*
+ * Write the frame index and the trailer that locates it.
+ */
+void WriteIndex(writer_t* pWriter)
+{
+	ubyte_t pTrailer[szTrailer];
+	struct iovec pIov[2];
+
+	Pack64(pTrailer, pWriter->szWritten);
+	Pack64(pTrailer + 8, pWriter->nFrames);
+	memcpy(pTrailer + 16, IndexMagic, 8);
+
+	pIov[0].iov_base = pWriter->pIndex;
+	pIov[0].iov_len = szIndexEntry * pWriter->nFrames;
+	pIov[1].iov_base = pTrailer;
+	pIov[1].iov_len = szTrailer;
+	WriteStats(pWriter->fd, pIov, 2, pIov[0].iov_len + szTrailer);
+}
+
+/*
+ * writev the pending chunks and free them. Unless bFinal is set, the
+ * held-back record and its chunk stay pending.
+ */
+void FlushZip(writer_t* pWriter, int bFinal, size_t nWriteIndex)
+{
+	int nKeep = (bFinal || pWriter->pLast == NULL) ? 0 : 1;
+	int nFree = pWriter->nPending - nKeep;
+
+	if (pWriter->nPending == 0)
+	{
+		return;
+	}
+	if (mVerbose)
+	{
+		fflush(stdout);
+	}
+
+	if (nKeep)
+	{
+		pWriter->pIov[pWriter->nPending - 1].iov_len -= pWriter->szLast;
+	}
+	WriteStats(pWriter->fd, pWriter->pIov, pWriter->nPending, 
+				pWriter->szPending - (nKeep ? pWriter->szLast : 0));
+
+	for (int i = 0; i < nFree; i++)
+	{
+		if (pWriter->pChunks[i] != NULL)
+		{
+			FreeZipStream(pWriter->pChunks[i], nWriteIndex);
+		}
+	}
+	pWriter->nPending = 0;
+	pWriter->szPending = 0;
+	if (nKeep)
+	{
+		pWriter->pIov[0].iov_base = pWriter->pLast;
+		pWriter->pIov[0].iov_len = pWriter->szLast;
+		pWriter->pChunks[0] = pWriter->pChunks[nFree];
+		pWriter->nPending = 1;
+		pWriter->szPending = pWriter->szLast;
+	}
+	else
+	{
+		pWriter->pLast = NULL;
+	}
+}
+
+/*
+ * Writev szData bytes, counting them and the time taken for --stats.
+ */
+void WriteStats(int fd, struct iovec* pIov, int nIov, size_t szData)
+{
+	uint64_t nsWrite = StatsNow();
+
+	Writev(fd, pIov, nIov);
+	StatAdd(&mWriterStats.nsWrite, StatsNow() - nsWrite);
+	StatAdd(&mWriterStats.szOut, szData);
+}
+
+void FreeZipStream(zipstream_t* pZipStream, size_t nWriteIndex)
+{
+	size_t szStream = pZipStream->streamsize;
+
+	PoolPut(pZipStream);
+	ReleaseInflight(szStream, nWriteIndex);
+}
+
+/*
+ * Free the stream buffer a pooled zipstream_t keeps between uses.
+ */
+void DestroyZipStream(void* pZipStream)
+{
+	free(((zipstream_t*) pZipStream)->stream);
 }
 
 void PrintStream(ubyte_t* pStream, size_t szStream)
 {
 	unsigned int ct;
-	for (int i=0; i < szStream; i++)
+	if (mFormat == FormatVarint)
+	{
+		PrintVarintStream(pStream, szStream);
+		return;
+	}
+	for (int i=0; i < szStream / szRleBytes; i++)
 	{
 		ct = 0;
 		for (int j=0; j < sizeof(int); j++)
@@ -352,3 +1546,68 @@ void PrintStream(ubyte_t* pStream, size_t szStream)
 		pStream++;
 	}
 }
+
+void PrintVarintStream(ubyte_t* pStream, size_t szStream)
+{
+	ubyte_t* pEnd = pStream + szStream;
+	uint64_t n;
+
+	while (pStream < pEnd)
+	{
+		pStream += UnpackVarint(pStream, pEnd, &n);
+		if (n & 1)
+		{
+			printf("\tliteral 0x%llx\n", (unsigned long long) (n >> 1));
+			pStream += n >> 1;
+		}
+		else
+		{
+			printf("\t0x%llx: %x\n", (unsigned long long) (n >> 1), *pStream);
+			pStream++;
+		}
+	}
+}
+
+/*
+ * Monotonic nanoseconds when --stats is on; 0, without the clock read,
+ * when it is off.
+ */
+uint64_t StatsNow()
+{
+	return mStats ? NowNs() : 0;
+}
+
+/*
+ * --stats-interval: print a JSON line of running totals every
+ * mnStatsInterval milliseconds until main sets mStatsDone.
+ */
+void* ReportStats()
+{
+	struct timespec deadline;
+
+	PthreadMutexLock(&mStatsLock);
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	while (!mStatsDone)
+	{
+		deadline.tv_sec += mnStatsInterval / 1000;
+		deadline.tv_nsec += (mnStatsInterval % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000)
+		{
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+		while (!mStatsDone 
+				&& pthread_cond_timedwait(&mStatsCond, &mStatsLock, 
+											&deadline) == 0)
+		{
+		}
+		if (!mStatsDone)
+		{
+			PrintStatsJson(stderr, mpStats, mnThreads, &mWriterStats, 
+							NowNs() - mnsStart);
+		}
+	}
+	PthreadMutexUnlock(&mStatsLock);
+
+	return NULL;
+}
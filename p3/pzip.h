@@ -1,14 +1,50 @@
+#include <stdint.h>
 #include <sys/types.h>
-typedef struct __filestat_t filestat_t;
+#include <sys/uio.h>
+typedef struct __mappedfile_t mappedfile_t;
+typedef struct __chunk_t chunk_t;
 typedef struct __zip_t zip_t;
 typedef struct __zipstream_t zipstream_t;
+typedef struct __writer_t writer_t;
+typedef struct __worker_t worker_t;
+typedef struct __reader_t reader_t;
 typedef unsigned char ubyte_t;
 
+void ParseArgs(int argc, char** argv);
+char* OptionValue(int* pArgc, char*** pArgv, char* szName);
+size_t ParseSize(char* szValue);
 void Init();
-void* CompressText();
-int GetNextPage(filestat_t* fs);
-void OpenNextFile(filestat_t* fs);
+void* CompressText(void* arg);
+chunk_t* GetChunkText(worker_t* pWorker, reader_t* pReader, ubyte_t** ppText);
+chunk_t* GetNextChunk(worker_t* pWorker, int bSteal);
+chunk_t* ClaimNodeChunk(int nNode);
+void* ReadStream(void* arg);
+void OpenFile(char* szName, mappedfile_t* pFile);
+void AdviseChunk(chunk_t* pChunk, int advice);
+size_t ChunkSizeFor(size_t szInput);
+void ReleaseChunk(chunk_t* pChunk);
+void ReleaseFile(mappedfile_t* pFile);
 void ZipPage(zipstream_t* fs);
+void ZipPageVarint(zipstream_t* fs);
+ubyte_t* PackLiteral(ubyte_t* pOut, ubyte_t* pText, ubyte_t* pTextEnd);
 void PutZip(zipstream_t* zipstream);
+void AcquireInflight(size_t szStream, size_t index);
+void ReleaseInflight(size_t szStream, size_t nWriteIndex);
 void* WriteZip();
+int OpenOutput(char* szName);
+void StartOutput(writer_t* pWriter, int fd);
+size_t WriteChunks(writer_t* pWriter, size_t nFirst, size_t nEnd);
+void FinishOutput(writer_t* pWriter, size_t nWriteIndex);
+size_t MergeRun(ubyte_t* pLast, ubyte_t* pStream, ubyte_t* pStreamEnd);
+void AppendZip(writer_t* pWriter, ubyte_t* pData, size_t szData, 
+				zipstream_t* pZipStream);
+void AppendFrame(writer_t* pWriter, zipstream_t* pZipStream, size_t szText);
+void WriteIndex(writer_t* pWriter);
+void FlushZip(writer_t* pWriter, int bFinal, size_t nWriteIndex);
+void WriteStats(int fd, struct iovec* pIov, int nIov, size_t szData);
+void FreeZipStream(zipstream_t* pZipStream, size_t nWriteIndex);
+void DestroyZipStream(void* pZipStream);
 void PrintStream(ubyte_t* pStream, size_t szStream);
+void PrintVarintStream(ubyte_t* pStream, size_t szStream);
+uint64_t StatsNow();
+void* ReportStats();
@@ -0,0 +1,100 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "ring.h"
+#include "utilities.h"
+
+#define RingSpins (64)
+
+ring_t* InitRing(size_t nCapacity)
+{
+	ring_t* pRing = Malloc(sizeof(ring_t));
+	pRing->nCapacity = nCapacity;
+	pRing->pSlots = Malloc(sizeof(ringslot_t) * nCapacity);
+	for (size_t i = 0; i < nCapacity; i++)
+	{
+		atomic_init(&pRing->pSlots[i].nSeq, i);
+		pRing->pSlots[i].pData = NULL;
+	}
+	atomic_init(&pRing->nWaiters, 0);
+	PthreadMutexInit(&pRing->lock);
+	PthreadCondInit(&pRing->cond);
+
+	return pRing;
+}
+
+/*
+ * Publish item nIndex, blocking while its slot still holds item
+ * nIndex - nCapacity.
+ */
+void RingPut(ring_t* pRing, size_t nIndex, void* pData)
+{
+	ringslot_t* pSlot = &pRing->pSlots[nIndex % pRing->nCapacity];
+
+	RingWait(pRing, &pSlot->nSeq, nIndex);
+	pSlot->pData = pData;
+	atomic_store(&pSlot->nSeq, nIndex + 1);
+	RingWake(pRing);
+}
+
+/*
+ * Take item nIndex, blocking until it is published.
+ */
+void* RingGet(ring_t* pRing, size_t nIndex)
+{
+	ringslot_t* pSlot = &pRing->pSlots[nIndex % pRing->nCapacity];
+	void* pData;
+
+	RingWait(pRing, &pSlot->nSeq, nIndex + 1);
+	pData = pSlot->pData;
+	pSlot->pData = NULL;
+	atomic_store(&pSlot->nSeq, nIndex + pRing->nCapacity);
+	RingWake(pRing);
+
+	return pData;
+}
+
+/*
+ * Wait for a slot to reach nSeq: spin briefly, then sleep on the ring's
+ * condition. Waiters register before their final check and publishers
+ * check for waiters after their store, so a wakeup cannot be lost.
+ */
+void RingWait(ring_t* pRing, atomic_size_t* pSeq, size_t nSeq)
+{
+	for (int i = 0; i < RingSpins; i++)
+	{
+		if (atomic_load(pSeq) == nSeq)
+		{
+			return;
+		}
+		sched_yield();
+	}
+
+	PthreadMutexLock(&pRing->lock);
+	atomic_fetch_add(&pRing->nWaiters, 1);
+	while (atomic_load(pSeq) != nSeq)
+	{
+		PthreadCondWait(&pRing->cond, &pRing->lock);
+	}
+	atomic_fetch_sub(&pRing->nWaiters, 1);
+	PthreadMutexUnlock(&pRing->lock);
+}
+
+void RingWake(ring_t* pRing)
+{
+	if (atomic_load(&pRing->nWaiters) > 0)
+	{
+		PthreadMutexLock(&pRing->lock);
+		PthreadCondBroadcast(&pRing->cond);
+		PthreadMutexUnlock(&pRing->lock);
+	}
+}
+
+void DestroyRing(ring_t* pRing)
+{
+	pthread_mutex_destroy(&pRing->lock);
+	pthread_cond_destroy(&pRing->cond);
+	free(pRing->pSlots);
+	free(pRing);
+}
@@ -0,0 +1,31 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+
+/*
+ * Bounded reorder ring: item n lives in slot n % nCapacity. A slot's
+ * sequence number is n while it is free for item n, n + 1 once item n is
+ * published, and n + nCapacity after the consumer takes it.
+ */
+typedef struct __ringslot_t
+{
+	atomic_size_t nSeq;
+	void* pData;
+} ringslot_t;
+
+typedef struct __ring_t
+{
+	size_t nCapacity;
+	ringslot_t* pSlots;
+	/* threads asleep on cond; publishers only take lock when nonzero */
+	atomic_int nWaiters;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} ring_t;
+
+ring_t* InitRing(size_t nCapacity);
+void RingPut(ring_t* pRing, size_t nIndex, void* pData);
+void* RingGet(ring_t* pRing, size_t nIndex);
+void RingWait(ring_t* pRing, atomic_size_t* pSeq, size_t nSeq);
+void RingWake(ring_t* pRing);
+void DestroyRing(ring_t* pRing);
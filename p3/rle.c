@@ -0,0 +1,112 @@
+#include "rle.h"
+
+unsigned int UnpackCount(unsigned char* pRecord)
+{
+	unsigned int ct = 0;
+
+	for (int i = sizeof(int) - 1; i >= 0; i--)
+	{
+		ct = (ct << Shift) + pRecord[i];
+	}
+
+	return ct;
+}
+
+void PackCount(unsigned char* pRecord, unsigned int ct)
+{
+	for (int i = 0; i < sizeof(int); i++)
+	{
+		pRecord[i] = ct >> (i * Shift);
+	}
+}
+
+uint64_t Unpack64(unsigned char* p)
+{
+	uint64_t n = 0;
+
+	for (int i = sizeof(uint64_t) - 1; i >= 0; i--)
+	{
+		n = (n << Shift) + p[i];
+	}
+
+	return n;
+}
+
+void Pack64(unsigned char* p, uint64_t n)
+{
+	for (int i = 0; i < sizeof(uint64_t); i++)
+	{
+		p[i] = n >> (i * Shift);
+	}
+}
+
+/*
+ * Write n as minimal LEB128 and return the number of bytes written.
+ */
+size_t PackVarint(unsigned char* p, uint64_t n)
+{
+	size_t szVarint = 1;
+
+	while (n >= 0x80)
+	{
+		*p++ = (n & 0x7f) | 0x80;
+		n >>= 7;
+		szVarint++;
+	}
+	*p = n;
+
+	return szVarint;
+}
+
+/*
+ * Write n as LEB128 padded to exactly szVarintMax bytes.
+ */
+void PackVarintWide(unsigned char* p, uint64_t n)
+{
+	for (int i = 0; i < szVarintMax - 1; i++)
+	{
+		p[i] = (n & 0x7f) | 0x80;
+		n >>= 7;
+	}
+	p[szVarintMax - 1] = n;
+}
+
+/*
+ * Read a LEB128 value from [p, pEnd) into *pn and return its length, or
+ * 0 if it is truncated or longer than szVarintMax bytes.
+ */
+size_t UnpackVarint(unsigned char* p, unsigned char* pEnd, uint64_t* pn)
+{
+	uint64_t n = 0;
+
+	for (int i = 0; i < szVarintMax && p + i < pEnd; i++)
+	{
+		n |= (uint64_t) (p[i] & 0x7f) << (7 * i);
+		if ((p[i] & 0x80) == 0)
+		{
+			*pn = n;
+			return i + 1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Name the format of a stream from its header record: FormatRaw unless it
+ * opens with a zero-count record naming another format.
+ */
+int StreamFormat(unsigned char* pStream, size_t szStream)
+{
+	if (szStream < szRleBytes || UnpackCount(pStream) != 0)
+	{
+		return FormatRaw;
+	}
+
+	switch (pStream[szRleBytes - 1])
+	{
+		case FormatFramed: return FormatFramed;
+		case FormatVarint: return FormatVarint;
+		default: return FormatRaw;
+	}
+}
@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * The pzip stream format: a sequence of 5-byte records, each a
+ * little-endian 4-byte run length followed by the run's byte.
+ */
+#define szRleBytes (5)
+#define Shift (8)
+/* longest run one record can hold; longer runs are split */
+#define MaxCount (UINT32_MAX)
+
+/*
+ * Other formats open with a record of count zero, which pzip never emits
+ * and plain decoders expand to nothing, whose byte names the format.
+ *
+ * Framed (--format=framed): after the header record, one frame per chunk,
+ * each a szFrameHeader header (8-byte compressed length, 8-byte
+ * uncompressed length) followed by that many bytes of records. Runs never
+ * cross frames. The frames are followed by an index of one szIndexEntry
+ * entry per frame (8-byte file offset of its header, 8-byte uncompressed
+ * offset), then a szTrailer trailer holding the index's file offset, the
+ * frame count and IndexMagic. All integers are little-endian.
+ *
+ * Varint (--format=varint): after the header record, a sequence of
+ * tokens, each an unsigned LEB128 value n followed by a payload. If n is
+ * even it is a run of n / 2 copies of the single payload byte; if odd,
+ * the payload is n / 2 literal bytes. Runs shorter than MinVarintRun are
+ * folded into literals. Non-minimal LEB128 values are allowed; pzip pads
+ * the run ending each chunk to szVarintMax bytes so the writer can merge
+ * the next chunk's first run into it in place.
+ */
+#define FormatRaw (0)
+#define FormatFramed ('F')
+#define FormatVarint ('V')
+#define szFrameHeader (16)
+#define szIndexEntry (16)
+#define szTrailer (24)
+#define IndexMagic "PZIPINDX"
+#define szVarintMax (10)
+#define MinVarintRun (3)
+
+unsigned int UnpackCount(unsigned char* pRecord);
+void PackCount(unsigned char* pRecord, unsigned int ct);
+uint64_t Unpack64(unsigned char* p);
+void Pack64(unsigned char* p, uint64_t n);
+size_t PackVarint(unsigned char* p, uint64_t n);
+void PackVarintWide(unsigned char* p, uint64_t n);
+size_t UnpackVarint(unsigned char* p, unsigned char* pEnd, uint64_t* pn);
+int StreamFormat(unsigned char* pStream, size_t szStream);
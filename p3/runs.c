@@ -0,0 +1,227 @@
+#include <stdlib.h>
+#include <string.h>
+#include "runs.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define RunsX86 (1)
+#endif
+
+runend_t FindRunEnd = FindRunEndScalar;
+runcount_t CountRuns = CountRunsScalar;
+
+/*
+ * Select FindRunEnd by CPUID, and CountRuns too when the CPU also has
+ * popcnt. PZIP_SIMD=scalar|sse2|avx2 in the environment forces a
+ * narrower implementation for testing.
+ */
+void InitRuns()
+{
+	char* szForce = getenv("PZIP_SIMD");
+
+	FindRunEnd = FindRunEndScalar;
+	CountRuns = CountRunsScalar;
+	if (szForce != NULL && strcmp(szForce, "scalar") == 0)
+	{
+		return;
+	}
+#ifdef RunsX86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+	{
+		FindRunEnd = FindRunEndSse2;
+		if (__builtin_cpu_supports("popcnt"))
+		{
+			CountRuns = CountRunsSse2;
+		}
+	}
+	if (szForce != NULL && strcmp(szForce, "sse2") == 0)
+	{
+		return;
+	}
+	if (__builtin_cpu_supports("avx2"))
+	{
+		FindRunEnd = FindRunEndAvx2;
+		if (__builtin_cpu_supports("popcnt"))
+		{
+			CountRuns = CountRunsAvx2;
+		}
+	}
+#endif
+}
+
+char* RunsImplName()
+{
+	if (FindRunEnd == FindRunEndAvx2)
+	{
+		return "avx2";
+	}
+	if (FindRunEnd == FindRunEndSse2)
+	{
+		return "sse2";
+	}
+	return "scalar";
+}
+
+unsigned char* FindRunEndScalar(unsigned char* p, unsigned char* pEnd)
+{
+	return FindByteEnd(p, pEnd, *p);
+}
+
+/*
+ * First byte in [p, pEnd) that is not c. The vector versions finish with
+ * this, since by then *p need not be the run byte.
+ */
+unsigned char* FindByteEnd(unsigned char* p, unsigned char* pEnd, 
+							unsigned char c)
+{
+	while (p < pEnd && *p == c)
+	{
+		p++;
+	}
+
+	return p;
+}
+
+/*
+ * Number of runs in [p, pEnd): one plus the number of adjacent byte pairs
+ * that differ.
+ */
+size_t CountRunsScalar(unsigned char* p, unsigned char* pEnd)
+{
+	size_t nRuns;
+
+	if (p == pEnd)
+	{
+		return 0;
+	}
+	nRuns = 1;
+	for (p++; p < pEnd; p++)
+	{
+		nRuns += *p != *(p - 1);
+	}
+
+	return nRuns;
+}
+
+#ifdef RunsX86
+
+/*
+ * Compare 16 bytes at a time against the broadcast run byte; the first
+ * clear bit of the movemask is the run end.
+ */
+__attribute__((target("sse2")))
+unsigned char* FindRunEndSse2(unsigned char* p, unsigned char* pEnd)
+{
+	unsigned char run = *p;
+	__m128i c = _mm_set1_epi8(run);
+	unsigned int mask;
+
+	while (pEnd - p >= 16)
+	{
+		mask = _mm_movemask_epi8(
+			_mm_cmpeq_epi8(_mm_loadu_si128((__m128i*) p), c));
+		if (mask != 0xFFFF)
+		{
+			return p + __builtin_ctz(~mask);
+		}
+		p += 16;
+	}
+
+	return FindByteEnd(p, pEnd, run);
+}
+
+__attribute__((target("avx2")))
+unsigned char* FindRunEndAvx2(unsigned char* p, unsigned char* pEnd)
+{
+	unsigned char run = *p;
+	__m256i c = _mm256_set1_epi8(run);
+	unsigned int mask;
+
+	while (pEnd - p >= 32)
+	{
+		mask = _mm256_movemask_epi8(
+			_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i*) p), c));
+		if (mask != 0xFFFFFFFF)
+		{
+			return p + __builtin_ctz(~mask);
+		}
+		p += 32;
+	}
+
+	return FindByteEnd(p, pEnd, run);
+}
+
+/*
+ * Compare each 16-byte block with itself shifted by one byte and count
+ * the mismatches.
+ */
+__attribute__((target("sse2,popcnt")))
+size_t CountRunsSse2(unsigned char* p, unsigned char* pEnd)
+{
+	size_t nRuns;
+	unsigned int mask;
+
+	if (p == pEnd)
+	{
+		return 0;
+	}
+	nRuns = 1;
+	while (pEnd - p > 16)
+	{
+		mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+			_mm_loadu_si128((__m128i*) p), 
+			_mm_loadu_si128((__m128i*) (p + 1))));
+		nRuns += 16 - __builtin_popcount(mask);
+		p += 16;
+	}
+
+	return nRuns + CountRunsScalar(p, pEnd) - 1;
+}
+
+__attribute__((target("avx2,popcnt")))
+size_t CountRunsAvx2(unsigned char* p, unsigned char* pEnd)
+{
+	size_t nRuns;
+	unsigned int mask;
+
+	if (p == pEnd)
+	{
+		return 0;
+	}
+	nRuns = 1;
+	while (pEnd - p > 32)
+	{
+		mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(
+			_mm256_loadu_si256((__m256i*) p), 
+			_mm256_loadu_si256((__m256i*) (p + 1))));
+		nRuns += 32 - __builtin_popcount(mask);
+		p += 32;
+	}
+
+	return nRuns + CountRunsScalar(p, pEnd) - 1;
+}
+
+#else
+
+unsigned char* FindRunEndSse2(unsigned char* p, unsigned char* pEnd)
+{
+	return FindRunEndScalar(p, pEnd);
+}
+
+unsigned char* FindRunEndAvx2(unsigned char* p, unsigned char* pEnd)
+{
+	return FindRunEndScalar(p, pEnd);
+}
+
+size_t CountRunsSse2(unsigned char* p, unsigned char* pEnd)
+{
+	return CountRunsScalar(p, pEnd);
+}
+
+size_t CountRunsAvx2(unsigned char* p, unsigned char* pEnd)
+{
+	return CountRunsScalar(p, pEnd);
+}
+
+#endif
@@ -0,0 +1,23 @@
+#include <sys/types.h>
+
+/*
+ * Run boundary detection. FindRunEnd returns the first byte in [p, pEnd)
+ * that differs from *p and CountRuns the number of runs in [p, pEnd);
+ * InitRuns points both at the widest implementation the CPU supports.
+ */
+typedef unsigned char* (*runend_t)(unsigned char* p, unsigned char* pEnd);
+typedef size_t (*runcount_t)(unsigned char* p, unsigned char* pEnd);
+
+extern runend_t FindRunEnd;
+extern runcount_t CountRuns;
+
+void InitRuns();
+char* RunsImplName();
+unsigned char* FindRunEndScalar(unsigned char* p, unsigned char* pEnd);
+unsigned char* FindByteEnd(unsigned char* p, unsigned char* pEnd, 
+	unsigned char c);
+unsigned char* FindRunEndSse2(unsigned char* p, unsigned char* pEnd);
+unsigned char* FindRunEndAvx2(unsigned char* p, unsigned char* pEnd);
+size_t CountRunsScalar(unsigned char* p, unsigned char* pEnd);
+size_t CountRunsSse2(unsigned char* p, unsigned char* pEnd);
+size_t CountRunsAvx2(unsigned char* p, unsigned char* pEnd);
@@ -0,0 +1,108 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "stats.h"
+
+#define NsPerSec (1000000000.0)
+#define BytesPerMiB (1048576.0)
+
+uint64_t NowNs()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * Add to a counter only its owning thread writes.
+ */
+void StatAdd(stat_t* pStat, uint64_t n)
+{
+	atomic_store_explicit(pStat, 
+			atomic_load_explicit(pStat, memory_order_relaxed) + n, 
+			memory_order_relaxed);
+}
+
+uint64_t StatGet(stat_t* pStat)
+{
+	return atomic_load_explicit(pStat, memory_order_relaxed);
+}
+
+/*
+ * Print a summary table: totals and throughput, a line per worker and
+ * the writer's stall and write times.
+ */
+void PrintStats(FILE* fp, workerstats_t* pWorkers, int nWorkers, 
+				writerstats_t* pWriter, uint64_t nsElapsed)
+{
+	workerstats_t* pWorker;
+	uint64_t szIn = 0;
+	uint64_t szOut = StatGet(&pWriter->szOut);
+	double secs = nsElapsed / NsPerSec;
+
+	for (int i = 0; i < nWorkers; i++)
+	{
+		szIn += StatGet(&pWorkers[i].szIn);
+	}
+
+	fprintf(fp, "pzip: %.3f s, %llu bytes in, %llu bytes out, %.1f MiB/s\n", 
+			secs, (unsigned long long) szIn, (unsigned long long) szOut, 
+			secs > 0 ? szIn / BytesPerMiB / secs : 0.0);
+	fprintf(fp, "worker  chunks      bytes in        runs"
+			"   zip s  claim s    put s\n");
+	for (int i = 0; i < nWorkers; i++)
+	{
+		pWorker = &pWorkers[i];
+		fprintf(fp, "%6d %7llu %13llu %11llu %7.3f %8.3f %8.3f\n", i, 
+				(unsigned long long) StatGet(&pWorker->nChunks), 
+				(unsigned long long) StatGet(&pWorker->szIn), 
+				(unsigned long long) StatGet(&pWorker->nRuns), 
+				StatGet(&pWorker->nsZip) / NsPerSec, 
+				StatGet(&pWorker->nsClaim) / NsPerSec, 
+				StatGet(&pWorker->nsPut) / NsPerSec);
+	}
+	fprintf(fp, "writer: %.3f s stalled, %.3f s writing, "
+			"%llu stream bytes crossed NUMA nodes\n", 
+			StatGet(&pWriter->nsStall) / NsPerSec, 
+			StatGet(&pWriter->nsWrite) / NsPerSec, 
+			(unsigned long long) StatGet(&pWriter->szCrossNode));
+}
+
+/*
+ * Print one JSON object, on one line, of totals across the workers.
+ */
+void PrintStatsJson(FILE* fp, workerstats_t* pWorkers, int nWorkers, 
+					writerstats_t* pWriter, uint64_t nsElapsed)
+{
+	uint64_t pTotals[7] = {0};
+
+	for (int i = 0; i < nWorkers; i++)
+	{
+		pTotals[0] += StatGet(&pWorkers[i].nChunks);
+		pTotals[1] += StatGet(&pWorkers[i].szIn);
+		pTotals[2] += StatGet(&pWorkers[i].nRuns);
+		pTotals[3] += StatGet(&pWorkers[i].szOut);
+		pTotals[4] += StatGet(&pWorkers[i].nsZip);
+		pTotals[5] += StatGet(&pWorkers[i].nsClaim);
+		pTotals[6] += StatGet(&pWorkers[i].nsPut);
+	}
+
+	fprintf(fp, "{\"elapsed_ns\":%llu,\"chunks\":%llu,\"bytes_in\":%llu,"
+			"\"runs\":%llu,\"stream_bytes\":%llu,\"zip_ns\":%llu,"
+			"\"claim_ns\":%llu,\"put_ns\":%llu,\"bytes_out\":%llu,"
+			"\"writer_stall_ns\":%llu,\"writer_write_ns\":%llu,"
+			"\"cross_node_bytes\":%llu}\n", 
+			(unsigned long long) nsElapsed, 
+			(unsigned long long) pTotals[0], (unsigned long long) pTotals[1], 
+			(unsigned long long) pTotals[2], (unsigned long long) pTotals[3], 
+			(unsigned long long) pTotals[4], (unsigned long long) pTotals[5], 
+			(unsigned long long) pTotals[6], 
+			(unsigned long long) StatGet(&pWriter->szOut), 
+			(unsigned long long) StatGet(&pWriter->nsStall), 
+			(unsigned long long) StatGet(&pWriter->nsWrite), 
+			(unsigned long long) StatGet(&pWriter->szCrossNode));
+	fflush(fp);
+}
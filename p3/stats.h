@@ -0,0 +1,41 @@
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Pipeline counters for --stats. Each set is written by one thread only,
+ * with relaxed atomic stores, so updating them costs no more than a plain
+ * add; the atomics just let the reporter read them while they change.
+ * Sets are kept on their own cache lines.
+ */
+typedef _Atomic(uint64_t) stat_t;
+
+typedef struct __workerstats_t
+{
+	_Alignas(64) stat_t nChunks;
+	stat_t szIn;
+	stat_t nRuns;
+	stat_t szOut;
+	/* time compressing, waiting for a chunk and waiting to publish one */
+	stat_t nsZip;
+	stat_t nsClaim;
+	stat_t nsPut;
+} workerstats_t;
+
+typedef struct __writerstats_t
+{
+	_Alignas(64) stat_t szOut;
+	/* time waiting on the ring for the next chunk, and in writev */
+	stat_t nsStall;
+	stat_t nsWrite;
+	/* stream bytes taken from a chunk encoded on another NUMA node */
+	stat_t szCrossNode;
+} writerstats_t;
+
+uint64_t NowNs();
+void StatAdd(stat_t* pStat, uint64_t n);
+uint64_t StatGet(stat_t* pStat);
+void PrintStats(FILE* fp, workerstats_t* pWorkers, int nWorkers, 
+				writerstats_t* pWriter, uint64_t nsElapsed);
+void PrintStatsJson(FILE* fp, workerstats_t* pWorkers, int nWorkers, 
+					writerstats_t* pWriter, uint64_t nsElapsed);
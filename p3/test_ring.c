@@ -0,0 +1,84 @@
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "ring.h"
+#include "utilities.h"
+
+#define nProducers (4)
+#define nItems (10000)
+
+ring_t* mpRing;
+atomic_size_t mNextItem;
+
+/* publish items in whatever order the producers happen to claim them */
+void* Produce(void* arg)
+{
+	size_t nIndex;
+
+	while ((nIndex = atomic_fetch_add(&mNextItem, 1)) < nItems)
+	{
+		RingPut(mpRing, nIndex, (void*) (uintptr_t) (nIndex + 1));
+	}
+
+	return NULL;
+}
+
+int main()
+{
+	int nLength = 4;
+	ring_t* pRing;
+	char** data = Malloc(sizeof(char*) * nLength);
+	pthread_t threads[nProducers];
+
+	for (int i=0; i < nLength; i++)
+	{
+		data[i] = Malloc(sizeof(char) * 2);
+		data[i][0] = 'a' + i;
+		data[i][1] = '\0';
+	}
+
+	// out-of-order puts come back out in index order
+	pRing = InitRing(nLength);
+	for (int i = nLength - 1; i >= 0; i--)
+	{
+		RingPut(pRing, i, (void*) data[i]);
+	}
+	for (int i = 0; i < nLength; i++)
+	{
+		assert(strcmp(RingGet(pRing, i), data[i]) == 0);
+	}
+
+	// slots are reused once the consumer has moved past them
+	RingPut(pRing, nLength + 1, (void*) data[1]);
+	RingPut(pRing, nLength, (void*) data[0]);
+	assert(strcmp(RingGet(pRing, nLength), "a") == 0);
+	assert(strcmp(RingGet(pRing, nLength + 1), "b") == 0);
+	DestroyRing(pRing);
+
+	// producers block on a full ring until the consumer catches up
+	mpRing = InitRing(nLength);
+	atomic_init(&mNextItem, 0);
+	for (int i = 0; i < nProducers; i++)
+	{
+		PthreadCreate(&threads[i], NULL, Produce, NULL);
+	}
+	for (size_t i = 0; i < nItems; i++)
+	{
+		assert((uintptr_t) RingGet(mpRing, i) == i + 1);
+	}
+	for (int i = 0; i < nProducers; i++)
+	{
+		PthreadJoin(threads[i], NULL);
+	}
+	DestroyRing(mpRing);
+
+	for (int i = 0; i < nLength; i++)
+	{
+		free(data[i]);
+	}
+	free(data);
+
+	return 0;
+}
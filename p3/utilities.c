@@ -5,6 +5,7 @@
  * @version: 1.0
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <stdlib.h>
@@ -12,6 +13,7 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 void Close(int fd)
@@ -86,6 +88,18 @@ int Open(char* file, int flags)
 	return fd;
 }
 
+void PthreadCondBroadcast(pthread_cond_t* cond)
+{
+	int out;
+	out = pthread_cond_broadcast(cond);
+	if (out != 0)
+	{
+		printf("utilities.c:pthread_cond_broadcast:"
+			"conditional broadcast failed\n");
+		exit(1);
+	}
+}
+
 void PthreadCondInit(pthread_cond_t* cond)
 {
 	int out;
@@ -178,6 +192,37 @@ void PthreadMutexUnlock(pthread_mutex_t* mutex)
 	}
 }
 
+/*
+ * Wrapper for read() that retries until count bytes are read or the input
+ * ends. Returns the number of bytes read.
+ */
+size_t Read(int fd, void* buf, size_t count)
+{
+	size_t total = 0;
+	ssize_t out;
+
+	while (total < count)
+	{
+		out = read(fd, (char*) buf + total, count - total);
+		if (out < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			printf("utilities.c:read:read failed\n");
+			exit(1);
+		}
+		if (out == 0)
+		{
+			break;
+		}
+		total += out;
+	}
+
+	return total;
+}
+
 void* Realloc(void* ptr, size_t size)
 {
 	void* out;
@@ -190,3 +235,37 @@ void* Realloc(void* ptr, size_t size)
 
 	return out;
 }
+
+/*
+ * Wrapper for writev() that retries until every byte is written. The iov
+ * array is consumed in the process.
+ */
+void Writev(int fd, struct iovec* iov, int iovcnt)
+{
+	ssize_t out;
+
+	while (iovcnt > 0)
+	{
+		out = writev(fd, iov, iovcnt);
+		if (out < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			printf("utilities.c:writev:write failed\n");
+			exit(1);
+		}
+		while (iovcnt > 0 && out >= (ssize_t) iov->iov_len)
+		{
+			out -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt > 0)
+		{
+			iov->iov_base = (char*) iov->iov_base + out;
+			iov->iov_len -= out;
+		}
+	}
+}
@@ -4,6 +4,7 @@
  * @version 1.0
  */
 #include <sys/stat.h>
+#include <sys/uio.h>
 #include <stdlib.h>
 
 void Close(int fd);
@@ -11,6 +12,7 @@ void Fstat(int fd, struct stat* fsp);
 void* Malloc(size_t size);
 void* Mmap(void* addr, size_t len, int prot, int flags, int fd, off_t offset);
 void Munmap(void* addr, size_t length);
+void PthreadCondBroadcast(pthread_cond_t* cond);
 void PthreadCondInit(pthread_cond_t* cond);
 void PthreadCondSignal(pthread_cond_t* cond);
 void PthreadCondWait(pthread_cond_t* restrict cond, 
@@ -22,4 +24,6 @@ void PthreadMutexInit(pthread_mutex_t* mutex);
 void PthreadMutexLock(pthread_mutex_t* mutex);
 void PthreadMutexUnlock(pthread_mutex_t* mutex);
 int Open(char* file, int flags);
+size_t Read(int fd, void* buf, size_t count);
 void* Realloc(void* ptr, size_t size);
+void Writev(int fd, struct iovec* iov, int iovcnt);
@@ -0,0 +1,160 @@
+#include <string.h>
+#include "arena.h"
+#include "utilities.h"
+
+/* bytes in an arena's first block; each further block doubles in size */
+#define szFirstBlock (16 * 1024)
+/* blocks grow no larger than this, unless one allocation needs more */
+#define szMaxBlock (4 * 1024 * 1024)
+/* alignment of arena_alloc, enough for the pointers in the nodes */
+#define szAlign sizeof(void*)
+/* slots in an arena's table of interned strings, a power of two */
+#define nInternSlots (1024)
+
+/*
+ * @fn void init_arena(arena_t* pArena)
+ * @brief Initializes an empty arena. Memory is allocated on first use.
+ * @param arena_t* pArena [out] The arena to initialize
+ */
+void init_arena(arena_t* pArena)
+{
+	pArena->block = NULL;
+	pArena->next = NULL;
+	pArena->left = 0;
+	pArena->interned = NULL;
+}
+
+/*
+ * @fn void* arena_alloc(arena_t* pArena, size_t size)
+ * @brief Allocates aligned memory, such as a node, from the arena. It is 
+ *        freed only with the whole arena.
+ * @param arena_t* pArena [in,out] The arena to allocate from
+ * @param size_t   size   [in]     Bytes to allocate
+ * @returns The allocated memory
+ */
+void* arena_alloc(arena_t* pArena, size_t size)
+{
+	size_t szPad = -(size_t)pArena->next & (szAlign - 1);
+	void* pOut;
+
+	if (szPad + size > pArena->left)
+	{
+		arena_reserve(pArena, size);
+		szPad = 0;
+	}
+	pOut = pArena->next + szPad;
+	pArena->next += szPad + size;
+	pArena->left -= szPad + size;
+
+	return pOut;
+}
+
+/*
+ * @fn char* arena_copy_string(arena_t* pArena, char* pString)
+ * @brief Copies a string into the arena, packed against the one before
+ * @param arena_t* pArena  [in,out] The arena to copy into
+ * @param char*    pString [in]     The string to copy
+ * @returns The copy, freed only with the whole arena
+ */
+char* arena_copy_string(arena_t* pArena, char* pString)
+{
+	size_t size = strlen(pString) + 1;
+	char* pOut;
+
+	if (size > pArena->left)
+	{
+		arena_reserve(pArena, size);
+	}
+	pOut = pArena->next;
+	memcpy(pOut, pString, size);
+	pArena->next += size;
+	pArena->left -= size;
+
+	return pOut;
+}
+
+/*
+ * @fn char* arena_intern_string(arena_t* pArena, char* pString)
+ * @brief Returns a copy of a string in the arena, shared with earlier
+ *        callers that interned an equal string. The table is a fixed
+ *        number of slots, each keeping the last string that hashed to it,
+ *        so repeated strings such as counts cost one copy while the table
+ *        stays small however many distinct strings pass through.
+ * @param arena_t* pArena  [in,out] The arena to copy into
+ * @param char*    pString [in]     The string to intern
+ * @returns The shared copy, freed only with the whole arena
+ */
+char* arena_intern_string(arena_t* pArena, char* pString)
+{
+	unsigned long hash = 5381;
+	char** pSlot;
+
+	for (char* p = pString; *p != '\0'; p++)
+	{
+		hash = hash * 33 + *p;
+	}
+	if (pArena->interned == NULL)
+	{
+		pArena->interned = Malloc(nInternSlots * sizeof(char*));
+		memset(pArena->interned, 0, nInternSlots * sizeof(char*));
+	}
+
+	pSlot = &pArena->interned[hash & (nInternSlots - 1)];
+	if (*pSlot == NULL || strcmp(*pSlot, pString) != 0)
+	{
+		*pSlot = arena_copy_string(pArena, pString);
+	}
+
+	return *pSlot;
+}
+
+/*
+ * @fn void arena_reserve(arena_t* pArena, size_t size)
+ * @brief Starts a new block with room for at least size aligned bytes. The
+ *        rest of the current block is left unused.
+ * @param arena_t* pArena [in,out] The arena to grow
+ * @param size_t   size   [in]     Bytes the new block must hold
+ */
+void arena_reserve(arena_t* pArena, size_t size)
+{
+	size_t szHeader = (sizeof(arena_block_t) + szAlign - 1) & ~(szAlign - 1);
+	size_t szBlock = szFirstBlock;
+	arena_block_t* pBlock;
+
+	if (pArena->block != NULL)
+	{
+		szBlock = pArena->block->size < szMaxBlock 
+			? 2 * pArena->block->size : szMaxBlock;
+	}
+	if (szBlock < szHeader + size)
+	{
+		szBlock = szHeader + size;
+	}
+
+	pBlock = Malloc(szBlock);
+	pBlock->prev = pArena->block;
+	pBlock->size = szBlock;
+	pArena->block = pBlock;
+	pArena->next = (char*)pBlock + szHeader;
+	pArena->left = szBlock - szHeader;
+}
+
+/*
+ * @fn void destroy_arena(arena_t* pArena)
+ * @brief Frees all memory allocated from the arena, a block at a time
+ * @param arena_t* pArena [in,out] The arena to destroy
+ */
+void destroy_arena(arena_t* pArena)
+{
+	arena_block_t* pBlock = pArena->block;
+	arena_block_t* pPrev;
+
+	while (pBlock != NULL)
+	{
+		pPrev = pBlock->prev;
+		free(pBlock);
+		pBlock = pPrev;
+	}
+	free(pArena->interned);
+	init_arena(pArena);
+}
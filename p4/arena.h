@@ -0,0 +1,33 @@
+#ifndef __arena_h__
+#define __arena_h__
+
+#include <stddef.h>
+
+typedef struct __arena_block_t arena_block_t;
+struct __arena_block_t
+{
+	/* the block allocated before this one */
+	arena_block_t* prev;
+	/* bytes in the block, this header included */
+	size_t size;
+};
+
+typedef struct __arena_t
+{
+	/* the block being allocated from, which links to the earlier ones */
+	arena_block_t* block;
+	/* the next free byte of the block and the bytes left after it */
+	char* next;
+	size_t left;
+	/* strings recently interned, by hash; allocated on first use */
+	char** interned;
+} arena_t;
+
+void init_arena(arena_t* pArena);
+void* arena_alloc(arena_t* pArena, size_t size);
+char* arena_copy_string(arena_t* pArena, char* pString);
+char* arena_intern_string(arena_t* pArena, char* pString);
+void arena_reserve(arena_t* pArena, size_t size);
+void destroy_arena(arena_t* pArena);
+
+#endif // __arena_h__
@@ -6,7 +6,7 @@
 
 void Map(char* file_name)
 {
-	FILE* fp = fopen(file_name, "r");
+	FILE* fp = MR_Open(file_name);
 	assert(fp != NULL);
 
 	char* line = NULL;
@@ -28,18 +28,43 @@ void Map(char* file_name)
 	fclose(fp);
 }
 
+char* Combine(char* key, Getter get_next, int partition_number)
+{
+	int count = 0;
+	char* value;
+	while ((value = get_next(key, partition_number)) != NULL)
+	{
+		count += atoi(value);
+	}
+	char* combined = malloc(16);
+	assert(combined != NULL);
+	snprintf(combined, 16, "%d", count);
+	return combined;
+}
+
 void Reduce(char* key, Getter get_next, int partition_number)
 {
 	int count = 0;
 	char* value;
 	while ((value = get_next(key, partition_number)) != NULL)
 	{
-		count++;
+		count += atoi(value);
 	}
 	printf("%s %d\n", key, count);
 }
 
+// The environment picks the MR_Run options, so tests can cover them all:
+//   WORDCOUNT_SHUFFLE=tree  adds pairs to partition treemaps (default sort)
+//   WORDCOUNT_COMBINE=0     runs without the Combiner
+//   WORDCOUNT_SPLIT_SIZE=n  splits input files into n-byte ranges (1 MiB)
 int main(int argc, char* argv[])
 {
-	MR_Run(argc, argv, Map, 10, Reduce, 1, MR_DefaultHashPartition);
+	char* shuffle = getenv("WORDCOUNT_SHUFFLE");
+	char* combine = getenv("WORDCOUNT_COMBINE");
+	char* split_size = getenv("WORDCOUNT_SPLIT_SIZE");
+
+	MR_SetSplitSize(split_size != NULL ? atol(split_size) : 1 << 20);
+	MR_SetSortShuffle(shuffle == NULL || strcmp(shuffle, "tree") != 0);
+	MR_RunEx(argc, argv, Map, 10, Reduce, 1, MR_DefaultHashPartition, 
+		combine == NULL || strcmp(combine, "0") != 0 ? Combine : NULL);
 }
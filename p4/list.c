@@ -1,17 +1,18 @@
 #include <stdio.h>
+#include "arena.h"
 #include "listnode.h"
 #include "list.h"
-#include "utilities.h"
 
 /*
- * @fn list_t* init_list()
+ * @fn list_t* init_list(arena_t* pArena)
  * @brief Construct new linked list
+ * @param arena_t* pArena [in,out] The arena holding the list and its nodes
  * @returns pointer to list
  */
-list_t* init_list()
+list_t* init_list(arena_t* pArena)
 {
 	list_t* pList;
-	pList = Malloc(sizeof(list_t));
+	pList = arena_alloc(pArena, sizeof(list_t));
 	pList->head = NULL;
 	pList->cursor = NULL;
 	pList->size = 0;
@@ -19,16 +20,17 @@ list_t* init_list()
 }
 
 /*
- * @fn list_t* list_add(list_t* pList, char* pData)
+ * @fn list_t* list_add(arena_t* pArena, list_t* pList, char* pData)
  * @brief Add data to front of list
- * @param list_t* pList [in,out] list to add data to
- * @param char*   pData  [in]     data to add to list
+ * @param arena_t* pArena [in,out] arena holding the list
+ * @param list_t*  pList  [in,out] list to add data to
+ * @param char*    pData  [in]     data to add to list
  * @returns pointer to the list passed in
  */
-list_t* list_add(list_t* pList, char* pData)
+list_t* list_add(arena_t* pArena, list_t* pList, char* pData)
 {
 	list_node_t* pNode;
-	pNode = init_list_node(pData, pList->head);
+	pNode = init_list_node(pArena, pData, pList->head);
 	pList->head = pNode;
 	pList->size++;
 	return pList;
@@ -91,22 +93,6 @@ char* list_get_next(list_t* pList)
 	return pList->cursor->data;
 }
 
-/*
- * @fn void destroy_list(list_t* pList)
- * @brief Frees current list and all of its nodes
- * @param list_t* pList [in,out] The list to destroy
- */
-void destroy_list(list_t* pList)
-{
-	if (pList == NULL)
-	{
-		return;
-	}
-
-	destroy_list_node(pList->head);
-	free(pList);
-}
-
 void print_list(list_t* pList)
 {
 	r_print_list_node(pList->head);
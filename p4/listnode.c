@@ -1,20 +1,21 @@
 #include <stdio.h>
+#include "arena.h"
 #include "listnode.h"
-#include "utilities.h"
 
 /*
  * @fn list_node_t* init_list_node(char* pData, list_node_t* pNext)
  * @brief Constructs a new node containing the specified data pointing to the
  *        next node in the list
- * @param char*        pData [in] This node's data
- * @param list_node_t* pNext [in] The node following this node
+ * @param arena_t*     pArena [in,out] The arena holding the node and data
+ * @param char*        pData  [in]     This node's data
+ * @param list_node_t* pNext  [in]     The node following this node
  * @returns The creates list node
  */
-list_node_t* init_list_node(char* pData, list_node_t* pNext)
+list_node_t* init_list_node(arena_t* pArena, char* pData, list_node_t* pNext)
 {
 	list_node_t* pListNode;
-	pListNode = Malloc(sizeof(list_node_t));
-	pListNode->data = CopyString(pData);
+	pListNode = arena_alloc(pArena, sizeof(list_node_t));
+	pListNode->data = arena_intern_string(pArena, pData);
 	pListNode->next = pNext;
 	return pListNode;
 }
@@ -52,23 +53,6 @@ void set_next(list_node_t* pListNode, list_node_t* pNext)
 	pListNode->next = pNext;
 }
 
-/*
- * @fn void destroy_list-node(list_node_t* pListNode)
- * @brief Frees the current node and all nodes following it, recursively
- * @param list_node_t* pListNode [in,out] The node to destroy
- */
-void destroy_list_node(list_node_t* pListNode)
-{
-	if (pListNode == NULL)
-	{
-		return;
-	}
-
-	destroy_list_node(pListNode->next);
-	free(pListNode->data);
-	free(pListNode);
-}
-
 void r_print_list_node(list_node_t* pListNode)
 {
 	if (pListNode == NULL)
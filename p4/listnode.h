@@ -1,6 +1,8 @@
 #ifndef __list_node_h__
 #define __list_node_h__
 
+#include "arena.h"
+
 typedef struct __list_node_t list_node_t;
 struct __list_node_t
 {
@@ -10,11 +12,10 @@ struct __list_node_t
 	list_node_t* next;
 };
 
-list_node_t* init_list_node(char* pData, list_node_t* pNext);
+list_node_t* init_list_node(arena_t* pArena, char* pData, list_node_t* pNext);
 char* get_data(list_node_t* pListNode);
 list_node_t* get_next_node(list_node_t* pListNode);
 void set_next(list_node_t* pListNode, list_node_t* pNext);
-void destroy_list_node(list_node_t* pListNode);
 void r_print_list_node(list_node_t* pListNode);
 
 #endif // __list_node_h__
@@ -1,35 +1,57 @@
 // DEBUGGING
+#include <fcntl.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "mapreduce.h"
+#include "merger.h"
 #include "partition.h"
 #include "treemap.h"
 #include "utilities.h"
 
-#define szBuffer (64)
+/* bytes a mapper's bucket holds before it is flushed to its partition */
+#define szEmitBatch (64 * 1024)
 
-/* bounded buffer of key-value pairs */
-kv_t Buffer[szBuffer];
-int nFull;
-int FillIndex = 0;
-int UseIndex = 0;
-pthread_mutex_t BufferLock;
-pthread_cond_t BufferFill;
-pthread_cond_t BufferEmpty;
-
-/* Flag set when finished producing */
-int Done = 0;
+/* input splits, claimed in order by mapper threads */
+split_t* pSplits;
+int nSplits;
+int NextSplit = 0;
+pthread_mutex_t SplitLock;
+/* files larger than this are split for MR_Open; 0 maps files whole */
+off_t SplitSize = 0;
+/* the split the calling mapper thread is working on */
+__thread split_t* pCurrentSplit = NULL;
+/* the calling mapper thread's buckets, one per partition */
+__thread emit_bucket_t* pEmitBuckets = NULL;
+/* the calling mapper thread's sorted runs, one merger per partition */
+__thread merger_t* pEmitRuns = NULL;
+/* the pairs whose values the running Combiner has yet to get */
+__thread char** pCombinePairs;
+__thread int nCombinePairs;
 
 /* The mapping function passed to MR_Run */
 Mapper MapFn;
 /* Reduce function passed to MR_Run */
 Reducer ReduceFn;
+/* Combine function passed to MR_RunEx, or NULL */
+Combiner CombineFn;
 /* Partiton function passed to MR_Run, if present, default partiton otherwise */
 Partitioner PartitionFn;
 /* the number of partions */
 int nPartitions;
 /* Partition structures */
 partition_t* pPartitions;
+/* set by MR_SetSortShuffle */
+int bSortShuffle = 0;
+/* sorted runs for the sort shuffle, a row of nPartitions per mapper thread
+ * and a last row for pairs emitted from other threads */
+merger_t* pMapperRuns;
+/* pairs emitted from other threads for the sort shuffle, each guarded by
+ * its partition's lock */
+emit_bucket_t* pSharedBuckets;
 
 /*
  * @fn unsigned long MR_DefaultHashPartition(char* key, int num_partitions)
@@ -56,9 +78,13 @@ unsigned long MR_DefaultHashPartition(char* key, int num_partitions)
  *            Partitioner partition)
  * @brief Runs distributed map-reduce using user defined Map and Reduce 
  *        operations. 
- *        Keys are generated concurrently and distributed across a number of 
- *        partitions equal to the number of reducers specified. 
+ *        Keys are generated concurrently by num_mappers threads, each 
+ *        mapping the next input file or byte range of one, and distributed
+ *        across a number of partitions equal to the number of reducers
+ *        specified. 
  *        Reducer operations only run after all Mappers have completed. 
+ *        With the sort shuffle, each mapper's pairs reach the reducers as
+ *        runs sorted by key that are merged while reducing.
  *        Key are guaranteed to be processed in sorted order by reducers within
  *        a partition
  * @param int         argc         [in] Command line argument count
@@ -77,15 +103,41 @@ void MR_Run(int argc, char* argv[],
 			Mapper map, int num_mappers,
 			Reducer reduce, int num_reducers,
 			Partitioner partition)
+{
+	MR_RunEx(argc, argv, map, num_mappers, reduce, num_reducers, partition,
+				NULL);
+}
+
+/*
+ * @fn MR_RunEx(int argc, char* argv[], 
+ *              Mapper map, int num_mappers,
+ *              Reducer reduce, int num_reducers,
+ *              Partitioner partition, Combiner combine)
+ * @brief MR_Run with an optional Combiner. Each mapper thread sorts the 
+ *        pairs it has buffered for a partition by key and replaces the
+ *        values of each key with the one the Combiner returns, so that
+ *        partitions and reducers see far fewer pairs. A key's pairs may be
+ *        combined several times, and a single pair is passed on as is, so
+ *        the Combiner must give values the Reducer and the Combiner itself
+ *        accept in place of the originals.
+ * @param Combiner    combine      [in] Combine function pointer, or NULL.
+ *                                      Returns a value allocated with
+ *                                      malloc, which MR_RunEx frees
+ *        See MR_Run for the other parameters.
+ */
+void MR_RunEx(int argc, char* argv[], 
+			Mapper map, int num_mappers,
+			Reducer reduce, int num_reducers,
+			Partitioner partition, Combiner combine)
 {
 	pthread_t* pConsumers;
+	pthread_t* pMappers;
 
-	PthreadMutexInit(&BufferLock);
-	PthreadCondInit(&BufferFill);
-	PthreadCondInit(&BufferEmpty);
+	PthreadMutexInit(&SplitLock);
 
 	MapFn = map;
 	ReduceFn = reduce;
+	CombineFn = combine;
 	PartitionFn = partition != NULL ? partition : MR_DefaultHashPartition;
 	nPartitions = num_reducers;
 
@@ -95,23 +147,45 @@ void MR_Run(int argc, char* argv[],
 		init_partition(&pPartitions[i]);
 	}
 
-	pConsumers = Malloc(num_mappers * sizeof(pthread_t));
-	for (int i = 0; i < num_mappers; i++)
+	if (bSortShuffle)
 	{
-		PthreadCreate(&pConsumers[i], NULL, do_consume, NULL);
+		pMapperRuns = Malloc((num_mappers + 1) * nPartitions 
+								* sizeof(merger_t));
+		for (int i = 0; i < (num_mappers + 1) * nPartitions; i++)
+		{
+			init_merger(&pMapperRuns[i]);
+		}
+		pSharedBuckets = Malloc(nPartitions * sizeof(emit_bucket_t));
+		for (int i = 0; i < nPartitions; i++)
+		{
+			pSharedBuckets[i].pData = NULL;
+			pSharedBuckets[i].szData = 0;
+			pSharedBuckets[i].szCapacity = 0;
+			pSharedBuckets[i].bSorted = 0;
+		}
 	}
 
-	do_produce(argc, argv);
-
-	Done = 1;
-	PthreadCondBroadcast(&BufferFill);
-
+	make_splits(argc, argv);
+	pMappers = Malloc(num_mappers * sizeof(pthread_t));
 	for (int i = 0; i < num_mappers; i++)
 	{
-		PthreadJoin(pConsumers[i], NULL);
+		int* arg = Malloc(sizeof(int));
+		*arg = i;
+		PthreadCreate(&pMappers[i], NULL, do_map, (void*)arg);
+	}
+	for (int i = 0; i < num_mappers; i++)
+	{
+		PthreadJoin(pMappers[i], NULL);
+	}
+	free(pMappers);
+	free(pSplits);
+
+	if (bSortShuffle)
+	{
+		do_gather_runs(num_mappers);
 	}
 
-	pConsumers = Realloc(pConsumers, num_reducers * sizeof(pthread_t));
+	pConsumers = Malloc(num_reducers * sizeof(pthread_t));
 	for (int i = 0; i < num_reducers; i++)
 	{
 		int* arg = Malloc(sizeof(int));
@@ -133,111 +207,494 @@ void MR_Run(int argc, char* argv[],
 }
 
 /*
- * @fn void do_produce(int argc, char** argv)
- * @brief Applies the user specified Mapper to each command line argument
+ * @fn void MR_SetSplitSize(off_t split_size)
+ * @brief Lets MR_Run split files larger than split_size bytes into byte
+ *        ranges mapped separately. Only for Mappers that read their input
+ *        through MR_Open. Call before MR_Run.
+ * @param off_t split_size [in] Bytes per split, or 0 to map files whole
+ */
+void MR_SetSplitSize(off_t split_size)
+{
+	SplitSize = split_size;
+}
+
+/*
+ * @fn void MR_SetSortShuffle(int sort_shuffle)
+ * @brief Chooses how pairs get from mappers to reducers. By default each
+ *        mapper adds its pairs to the partition's treemap under the
+ *        partition lock. With sort_shuffle set, each mapper instead sorts
+ *        its pairs into runs of its own, and reducers merge the runs of
+ *        their partition. Call before MR_Run.
+ * @param int sort_shuffle [in] Nonzero for the sort shuffle
+ */
+void MR_SetSortShuffle(int sort_shuffle)
+{
+	bSortShuffle = sort_shuffle;
+}
+
+/*
+ * @fn FILE* MR_Open(char* file_name)
+ * @brief Opens the part of file_name given to the calling Mapper for
+ *        reading: the whole file, or for a split, the lines that start
+ *        in its byte range. A line belongs to the split holding its first
+ *        byte, so no line is seen twice or cut in two.
+ *        A split's stream reads from a mapping that is unmapped when the
+ *        Mapper returns, so it is valid only until then. Opening the
+ *        split again reuses the mapping.
+ * @param char* file_name [in] The file name passed to the Mapper
+ * @returns A stream to close with fclose, or NULL on failure
+ */
+FILE* MR_Open(char* file_name)
+{
+	split_t* pSplit = pCurrentSplit;
+	struct stat s;
+	off_t base;
+	off_t start;
+	off_t end;
+	int fd;
+
+	if (pSplit == NULL || pSplit->start < 0 
+		|| strcmp(file_name, pSplit->file_name) != 0)
+	{
+		return fopen(file_name, "r");
+	}
+
+	// map from the page holding the byte before the range, which tells
+	// whether a line starts there, to the end of the file, as the last
+	// line may run on past the range
+	base = pSplit->start > 0 
+		? (pSplit->start - 1) / sysconf(_SC_PAGESIZE) * sysconf(_SC_PAGESIZE)
+		: 0;
+	if (pSplit->pText == NULL)
+	{
+		fd = Open(file_name, O_RDONLY);
+		Fstat(fd, &s);
+		pSplit->szText = s.st_size - base;
+		pSplit->pText = Mmap(NULL, pSplit->szText, PROT_READ, MAP_PRIVATE, 
+								fd, base);
+		Close(fd);
+	}
+
+	// move both ends forward to the start of a line, in offsets from base
+	start = pSplit->start - base;
+	while (start > 0 && start < pSplit->szText 
+			&& pSplit->pText[start - 1] != '\n')
+	{
+		start++;
+	}
+	end = pSplit->end - base;
+	if (end > pSplit->szText)
+	{
+		end = pSplit->szText;
+	}
+	while (end > 0 && end < pSplit->szText && pSplit->pText[end - 1] != '\n')
+	{
+		end++;
+	}
+	if (start > end)
+	{
+		start = end;
+	}
+
+	return fmemopen(pSplit->pText + start, end - start, "r");
+}
+
+/*
+ * @fn void make_splits(int argc, char** argv)
+ * @brief Lists the work for mapper threads: a split per command line
+ *        argument, or with a split size set, one per byte range of files
+ *        larger than it
  * @param int    argc [in] Command line argument count
  * @param char** argv [in] The command line arguments
  */
-void do_produce(int argc, char** argv)
+void make_splits(int argc, char** argv)
+{
+	struct stat s;
+	off_t size;
+	int nFileSplits;
+
+	pSplits = NULL;
+	nSplits = 0;
+	NextSplit = 0;
+	for (int i = 1; i < argc; i++)
+	{
+		// files that cannot be stat'd are left for the Mapper to report
+		size = stat(argv[i], &s) == 0 ? s.st_size : 0;
+		nFileSplits = 1;
+		if (SplitSize > 0 && size > SplitSize)
+		{
+			nFileSplits = (size + SplitSize - 1) / SplitSize;
+		}
+		pSplits = Realloc(pSplits, (nSplits + nFileSplits) * sizeof(split_t));
+		for (int j = 0; j < nFileSplits; j++)
+		{
+			pSplits[nSplits].file_name = argv[i];
+			pSplits[nSplits].start = nFileSplits > 1 ? j * SplitSize : -1;
+			pSplits[nSplits].end = (j + 1) * SplitSize;
+			pSplits[nSplits].pText = NULL;
+			pSplits[nSplits].szText = 0;
+			nSplits++;
+		}
+	}
+}
+
+/*
+ * @fn split_t* get_next_split()
+ * @brief Claims the next unmapped split
+ * @returns The split, or NULL once all have been claimed
+ */
+split_t* get_next_split()
+{
+	split_t* pSplit = NULL;
+
+	PthreadMutexLock(&SplitLock);
+	if (NextSplit < nSplits)
+	{
+		pSplit = &pSplits[NextSplit++];
+	}
+	PthreadMutexUnlock(&SplitLock);
+
+	return pSplit;
+}
+
+/*
+ * @fn void* do_map(void* arg)
+ * @brief Mapper thread: applies the user specified Mapper to splits until
+ *        none are left
+ * @param void* arg [in] Pointer to integer mapper number.
+ *                       Pointer is freed after use
+ * @returns NULL
+ */
+void* do_map(void* arg)
 {
-	while (--argc > 0)
+	int mapper_number = *(int*)arg;
+	free(arg);
+	split_t* pSplit;
+
+	pEmitBuckets = Malloc(nPartitions * sizeof(emit_bucket_t));
+	for (int i = 0; i < nPartitions; i++)
+	{
+		pEmitBuckets[i].pData = NULL;
+		pEmitBuckets[i].szData = 0;
+		pEmitBuckets[i].szCapacity = 0;
+		pEmitBuckets[i].bSorted = 0;
+	}
+	if (bSortShuffle)
+	{
+		pEmitRuns = &pMapperRuns[mapper_number * nPartitions];
+	}
+
+	while ((pSplit = get_next_split()) != NULL)
+	{
+		pCurrentSplit = pSplit;
+		MapFn(pSplit->file_name);
+		pCurrentSplit = NULL;
+		if (pSplit->pText != NULL)
+		{
+			Munmap(pSplit->pText, pSplit->szText);
+			pSplit->pText = NULL;
+		}
+	}
+
+	for (int i = 0; i < nPartitions; i++)
 	{
-		MapFn(*(++argv));
+		if (CombineFn != NULL)
+		{
+			do_combine_bucket(&pEmitBuckets[i], i);
+		}
+		do_flush_bucket(&pEmitBuckets[i], i);
+		free(pEmitBuckets[i].pData);
 	}
+	free(pEmitBuckets);
+	pEmitBuckets = NULL;
+	pEmitRuns = NULL;
+
+	return NULL;
 }
 
 /*
  * @fn void MR_Emit(char* key, char* value)
  * @brief Called by user map routine for each key-value pair.
- *        Queues key-value pairs for mapping.
+ *        Copies the pair into the calling mapper's bucket for its
+ *        partition, which goes to the partition in one batch once full, 
+ *        or with a Combiner, once combining no longer halves it.
+ *        Pairs emitted from other threads go to the partition directly,
+ *        or with the sort shuffle, to a bucket shared by such threads.
  * @param char* key   [in] Emitted key
  * @param char* value [in] Associated value
  */
 void MR_Emit(char* key, char* value)
 {
-	PthreadMutexLock(&BufferLock);
-	while (nFull == szBuffer)
+	int index = PartitionFn(key, nPartitions);
+	emit_bucket_t* pBucket;
+
+	if (pEmitBuckets == NULL)
+	{
+		PthreadMutexLock(&pPartitions[index].lock);
+		if (bSortShuffle)
+		{
+			bucket_add(&pSharedBuckets[index], key, value);
+		}
+		else
+		{
+			treemap_add(&pPartitions[index].treemap, key, value);
+		}
+		PthreadMutexUnlock(&pPartitions[index].lock);
+		return;
+	}
+
+	pBucket = &pEmitBuckets[index];
+	if (pBucket->szData > 0 
+		&& pBucket->szData + strlen(key) + strlen(value) + 2 > szEmitBatch)
 	{
-		PthreadCondWait(&BufferEmpty, &BufferLock);
+		if (CombineFn != NULL)
+		{
+			do_combine_bucket(pBucket, index);
+		}
+		if (CombineFn == NULL || pBucket->szData > szEmitBatch / 2)
+		{
+			do_flush_bucket(pBucket, index);
+		}
 	}
-	do_put(key, value);
-	PthreadCondSignal(&BufferFill);
-	PthreadMutexUnlock(&BufferLock);
+	bucket_add(pBucket, key, value);
 }
 
 /*
- * @fn void do_put(char* key, char* value)
- * @brief Pushes the key-value pair to the buffer to be mapped.
- *        Caller must be holding the buffer lock.
- * @param char*   key [in] Emitted key
- * @param char* value [in] Associated value
+ * @fn void bucket_add(emit_bucket_t* pBucket, char* key, char* value)
+ * @brief Appends a key-value pair to a bucket, growing it as needed
+ * @param emit_bucket_t* pBucket [in,out] The bucket to add to
+ * @param char*          key     [in]     The key
+ * @param char*          value   [in]     The value
+ */
+void bucket_add(emit_bucket_t* pBucket, char* key, char* value)
+{
+	size_t szKey = strlen(key) + 1;
+	size_t szValue = strlen(value) + 1;
+
+	if (pBucket->szData + szKey + szValue > pBucket->szCapacity)
+	{
+		pBucket->szCapacity = 2 * pBucket->szCapacity + szKey + szValue;
+		if (pBucket->szCapacity < szEmitBatch)
+		{
+			pBucket->szCapacity = szEmitBatch;
+		}
+		pBucket->pData = Realloc(pBucket->pData, pBucket->szCapacity);
+	}
+	memcpy(pBucket->pData + pBucket->szData, key, szKey);
+	memcpy(pBucket->pData + pBucket->szData + szKey, value, szValue);
+	pBucket->szData += szKey + szValue;
+	pBucket->bSorted = 0;
+}
+
+/*
+ * @fn char** bucket_pairs(emit_bucket_t* pBucket, int* pnPairs)
+ * @brief Lists the pairs in a bucket
+ * @param emit_bucket_t* pBucket [in]  The bucket, holding at least one pair
+ * @param int*           pnPairs [out] The number of pairs
+ * @returns Pointers to the bucket's pairs in order, to free with free
  */
-void do_put(char* key, char* value)
+char** bucket_pairs(emit_bucket_t* pBucket, int* pnPairs)
 {
-	Buffer[FillIndex].key = CopyString(key);
-	Buffer[FillIndex].value = CopyString(value);
-	FillIndex = (FillIndex + 1) % szBuffer;
-	nFull++;
+	char* pEnd = pBucket->pData + pBucket->szData;
+	char** pPairs;
+	char* pPair;
+	int nPairs = 0;
+
+	for (pPair = pBucket->pData; pPair < pEnd; nPairs++)
+	{
+		pPair += strlen(pPair) + 1;
+		pPair += strlen(pPair) + 1;
+	}
+	pPairs = Malloc(nPairs * sizeof(char*));
+	pPair = pBucket->pData;
+	for (int i = 0; i < nPairs; i++)
+	{
+		pPairs[i] = pPair;
+		pPair += strlen(pPair) + 1;
+		pPair += strlen(pPair) + 1;
+	}
+
+	*pnPairs = nPairs;
+	return pPairs;
 }
 
 /*
- * @fn void* do_consume(void* args)
- * @brief Gets a key value pair and files it to the appropriate partition
- * @param coid* arg [ign] Required, ignored.
- * @returns NULL
+ * @fn void do_combine_bucket(emit_bucket_t* pBucket, int partition_number)
+ * @brief Sorts a bucket's pairs by key and replaces each run of two or 
+ *        more pairs with a key by one pair holding the Combiner's value
+ * @param emit_bucket_t* pBucket          [in,out] The bucket to combine
+ * @param int            partition_number [in]     The bucket's partition
  */
-void* do_consume(void* args)
+void do_combine_bucket(emit_bucket_t* pBucket, int partition_number)
 {
-	kv_t kv;
-	while (1)
+	emit_bucket_t combined = { NULL, 0, 0, 0 };
+	char** pPairs;
+	char* pValue;
+	int nPairs;
+	int nKey;
+
+	if (pBucket->szData == 0)
 	{
-		PthreadMutexLock(&BufferLock);
-		while (nFull == 0 && Done == 0)
+		return;
+	}
+	pPairs = bucket_pairs(pBucket, &nPairs);
+	sort_pairs(pPairs, nPairs, 0);
+
+	for (int i = 0; i < nPairs; i += nKey)
+	{
+		nKey = 1;
+		while (i + nKey < nPairs && strcmp(pPairs[i], pPairs[i + nKey]) == 0)
 		{
-			PthreadCondWait(&BufferFill, &BufferLock);
+			nKey++;
 		}
-		if (nFull == 0 && Done == 1)
+		if (nKey == 1)
 		{
-			PthreadMutexUnlock(&BufferLock);
-			return NULL;
+			bucket_add(&combined, pPairs[i], pPairs[i] + strlen(pPairs[i]) + 1);
+			continue;
 		}
-		do_get(&kv);
-		PthreadCondSignal(&BufferEmpty);
-		PthreadMutexUnlock(&BufferLock);
-
-		do_put_partition(&kv);
+		pCombinePairs = &pPairs[i];
+		nCombinePairs = nKey;
+		pValue = CombineFn(pPairs[i], get_next_combined, partition_number);
+		bucket_add(&combined, pPairs[i], pValue);
+		free(pValue);
 	}
+
+	free(pPairs);
+	free(pBucket->pData);
+	*pBucket = combined;
+	pBucket->bSorted = 1;
 }
 
 /*
- * @fn void do_get(kv_t* pkv)
- * @brief Get the next key-value pair on the queue
- *        Caller must be holding the buffer lock
- * @param kv_t* pkv [out] Struct holding the key-value pair
+ * @fn char* get_next_combined(char* key, int partition_number)
+ * @brief Getter passed to the Combiner: the next value of the key being
+ *        combined
+ * @param char* key              [ign] The key being combined
+ * @param int   partition_number [ign] Its partition
+ * @returns The next value, or NULL once all have been returned
  */
-void do_get(kv_t* pkv)
+char* get_next_combined(char* key, int partition_number)
 {
-	*pkv = Buffer[UseIndex];
-	Buffer[UseIndex].key = NULL;
-	Buffer[UseIndex].value = NULL;
-	UseIndex = (UseIndex + 1) % szBuffer;
-	nFull--;
+	char* pPair;
+
+	if (nCombinePairs == 0)
+	{
+		return NULL;
+	}
+	pPair = *pCombinePairs++;
+	nCombinePairs--;
+
+	return pPair + strlen(pPair) + 1;
 }
 
 /*
- * @fn void do_put_partition(kv_t* pkv)
- * @brief Adds the key-value pair to the appropriate partition
- * @param kv_t* pkv [in] Struct holding the key-value pair
+ * @fn void do_flush_bucket(emit_bucket_t* pBucket, int partition_number)
+ * @brief Adds the pairs in a mapper's bucket to its partition under one
+ *        hold of the partition lock, or with the sort shuffle, to the
+ *        mapper's runs, and empties the bucket
+ * @param emit_bucket_t* pBucket          [in,out] The bucket to flush
+ * @param int            partition_number [in]     The bucket's partition
  */
-void do_put_partition(kv_t* pkv)
+void do_flush_bucket(emit_bucket_t* pBucket, int partition_number)
 {
-	int index = PartitionFn(pkv->key, nPartitions);
-	partition_t* pPartition = &pPartitions[index];
+	partition_t* pPartition = &pPartitions[partition_number];
+	char* pPair = pBucket->pData;
+	char* pEnd = pBucket->pData + pBucket->szData;
+	char* pValue;
+
+	if (pBucket->szData == 0)
+	{
+		return;
+	}
+	if (bSortShuffle)
+	{
+		do_add_run(pBucket, partition_number);
+		return;
+	}
+
 	PthreadMutexLock(&pPartition->lock);
-	treemap_add(&pPartition->treemap, pkv->key, pkv->value);
+	while (pPair < pEnd)
+	{
+		pValue = pPair + strlen(pPair) + 1;
+		treemap_add(&pPartition->treemap, pPair, pValue);
+		pPair = pValue + strlen(pValue) + 1;
+	}
 	PthreadMutexUnlock(&pPartition->lock);
-	free(pkv->key);
-	free(pkv->value);
+	pBucket->szData = 0;
+}
+
+/*
+ * @fn void do_add_run(emit_bucket_t* pBucket, int partition_number)
+ * @brief Sorts the pairs in a mapper's bucket into a run added to the 
+ *        mapper's runs for the partition, and empties the bucket
+ * @param emit_bucket_t* pBucket          [in,out] The bucket to add
+ * @param int            partition_number [in]     The bucket's partition
+ */
+void do_add_run(emit_bucket_t* pBucket, int partition_number)
+{
+	char** pPairs;
+	char* pRun;
+	size_t szPair;
+	size_t szRun = 0;
+	int nPairs;
+
+	if (pBucket->bSorted)
+	{
+		// a combined bucket is already in key order: hand it over whole
+		pRun = Realloc(pBucket->pData, pBucket->szData);
+		merger_add_run(&pEmitRuns[partition_number], pRun, pBucket->szData);
+		pBucket->pData = NULL;
+		pBucket->szData = 0;
+		pBucket->szCapacity = 0;
+		pBucket->bSorted = 0;
+		return;
+	}
+
+	pPairs = bucket_pairs(pBucket, &nPairs);
+	sort_pairs(pPairs, nPairs, 0);
+	pRun = Malloc(pBucket->szData);
+	for (int i = 0; i < nPairs; i++)
+	{
+		szPair = strlen(pPairs[i]) + 1;
+		szPair += strlen(pPairs[i] + szPair) + 1;
+		memcpy(pRun + szRun, pPairs[i], szPair);
+		szRun += szPair;
+	}
+	free(pPairs);
+	merger_add_run(&pEmitRuns[partition_number], pRun, szRun);
+	pBucket->szData = 0;
+}
+
+/*
+ * @fn void do_gather_runs(int num_mappers)
+ * @brief Once mappers have finished, adds the pairs emitted from other
+ *        threads as runs, and moves all runs to their partition's merger
+ * @param int num_mappers [in] The number of mapper threads
+ */
+void do_gather_runs(int num_mappers)
+{
+	pEmitRuns = &pMapperRuns[num_mappers * nPartitions];
+	for (int i = 0; i < nPartitions; i++)
+	{
+		if (CombineFn != NULL)
+		{
+			do_combine_bucket(&pSharedBuckets[i], i);
+		}
+		do_flush_bucket(&pSharedBuckets[i], i);
+		free(pSharedBuckets[i].pData);
+	}
+	free(pSharedBuckets);
+	pEmitRuns = NULL;
+
+	for (int i = 0; i < nPartitions; i++)
+	{
+		for (int j = 0; j <= num_mappers; j++)
+		{
+			merger_take_runs(&pPartitions[i].merger, 
+								&pMapperRuns[j * nPartitions + i]);
+		}
+	}
+	free(pMapperRuns);
 }
 
 /*
@@ -270,6 +727,11 @@ void* do_consume_partition(void* arg)
  */
 char* get_next_key(char* pKey, int partition_number)
 {
+	if (bSortShuffle)
+	{
+		return merger_get_next_key(&pPartitions[partition_number].merger, 
+									pKey);
+	}
 	return treemap_get_next_key(&pPartitions[partition_number].treemap, pKey);
 }
 
@@ -286,6 +748,11 @@ char* get_next(char* pKey, int partition_number)
 	{
 		return NULL;
 	}
+	if (bSortShuffle)
+	{
+		return merger_get_next_value(&pPartitions[partition_number].merger, 
+										pKey);
+	}
 
 	return treemap_get_next_value(&pPartitions[partition_number].treemap, pKey);
 }
@@ -1,34 +1,76 @@
 #ifndef __mapreduce_h__
 #define __mapreduce_h__
 
+#include <stdio.h>
+#include <sys/types.h>
+
 // Different function pointer types used by MR
 typedef char *(*Getter)(char *key, int partition_number);
 typedef void (*Mapper)(char *file_name);
 typedef void (*Reducer)(char *key, Getter get_func, int partition_number);
 typedef unsigned long (*Partitioner)(char *key, int num_partitions);
+typedef char *(*Combiner)(char *key, Getter get_func, int partition_number);
 
 // External functions: these are what you must define
 void MR_Emit(char *key, char *value);
 
 unsigned long MR_DefaultHashPartition(char *key, int num_partitions);
 
+// Optional: Mappers that open their input with MR_Open may be given part
+// of a file. Files larger than split_size bytes are then split into byte
+// ranges of about that size, each mapped separately on a line boundary.
+void MR_SetSplitSize(off_t split_size);
+FILE *MR_Open(char *file_name);
+
+// Optional: with sort_shuffle set, each mapper sorts the pairs it emits
+// into runs per partition, and reducers merge those runs, so mappers never
+// share a partition map or its lock.
+void MR_SetSortShuffle(int sort_shuffle);
+
 void MR_Run(int argc, char *argv[], 
 	    Mapper map, int num_mappers, 
 	    Reducer reduce, int num_reducers, 
 	    Partitioner partition);
 
-/* struct for passing key-value pairs */
-typedef struct __kv_t
+// MR_Run with a Combiner that pre-aggregates each mapper's pairs per key
+void MR_RunEx(int argc, char *argv[], 
+	      Mapper map, int num_mappers, 
+	      Reducer reduce, int num_reducers, 
+	      Partitioner partition, Combiner combine);
+
+/* a byte range of one input file: the unit of work of a mapper thread */
+typedef struct __split_t
 {
-	char* key;
-	char* value;
-} kv_t;
-
-void do_produce(int argc, char** argv);
-void do_put(char* key, char* value);
-void* do_consume(void* args);
-void do_get(kv_t* pkv);
-void do_put_partition(kv_t* pkv);
+	char* file_name;
+	/* the range [start, end), or start -1 for the whole file */
+	off_t start;
+	off_t end;
+	/* the file from the page before start to its end, mapped by MR_Open
+	 * and unmapped once MapFn returns */
+	char* pText;
+	size_t szText;
+} split_t;
+
+/* pairs a mapper has emitted for one partition, packed as key\0value\0 */
+typedef struct __emit_bucket_t
+{
+	char* pData;
+	size_t szData;
+	size_t szCapacity;
+	/* set while the pairs are in key order */
+	int bSorted;
+} emit_bucket_t;
+
+void make_splits(int argc, char** argv);
+split_t* get_next_split();
+void* do_map(void* arg);
+void bucket_add(emit_bucket_t* pBucket, char* key, char* value);
+char** bucket_pairs(emit_bucket_t* pBucket, int* pnPairs);
+void do_combine_bucket(emit_bucket_t* pBucket, int partition_number);
+char* get_next_combined(char* key, int partition_number);
+void do_flush_bucket(emit_bucket_t* pBucket, int partition_number);
+void do_add_run(emit_bucket_t* pBucket, int partition_number);
+void do_gather_runs(int num_mappers);
 void* do_consume_partition(void* arg);
 char* get_next_key(char* pKey, int partition_number);
 char* get_next(char* key, int partition_number);
@@ -0,0 +1,279 @@
+#include <string.h>
+#include "merger.h"
+#include "utilities.h"
+
+/* below this many pairs sort_pairs uses insertion sort */
+#define nInsertionSort 16
+
+/*
+ * @fn void init_merger(merger_t* pMerger)
+ * @brief Initializes a merger with no runs
+ * @param merger_t* pMerger [out] The merger to initialize
+ */
+void init_merger(merger_t* pMerger)
+{
+	pMerger->pRuns = NULL;
+	pMerger->nRuns = 0;
+	pMerger->nCapacity = 0;
+	pMerger->pHeap = NULL;
+	pMerger->nHeap = 0;
+	pMerger->bStarted = 0;
+}
+
+/*
+ * @fn void merger_add_run(merger_t* pMerger, char* pData, size_t szData)
+ * @brief Adds a sorted run to be merged. Call before the first
+ *        merger_get_next_key.
+ * @param merger_t* pMerger [in,out] The merger to add to
+ * @param char*     pData   [in]     Pairs sorted by key, packed as
+ *                                   key\0value\0. Allocated with malloc
+ *                                   and freed by the merger.
+ * @param size_t    szData  [in]     Bytes in pData
+ */
+void merger_add_run(merger_t* pMerger, char* pData, size_t szData)
+{
+	if (szData == 0)
+	{
+		free(pData);
+		return;
+	}
+	if (pMerger->nRuns == pMerger->nCapacity)
+	{
+		pMerger->nCapacity = pMerger->nCapacity > 0
+			? 2 * pMerger->nCapacity : 16;
+		pMerger->pRuns = Realloc(pMerger->pRuns,
+			pMerger->nCapacity * sizeof(run_t));
+	}
+	pMerger->pRuns[pMerger->nRuns].pData = pData;
+	pMerger->pRuns[pMerger->nRuns].pNext = pData;
+	pMerger->pRuns[pMerger->nRuns].pEnd = pData + szData;
+	pMerger->nRuns++;
+}
+
+/*
+ * @fn void merger_take_runs(merger_t* pMerger, merger_t* pFrom)
+ * @brief Moves all runs of one merger to another
+ * @param merger_t* pMerger [in,out] The merger to add to
+ * @param merger_t* pFrom   [in,out] The merger to empty
+ */
+void merger_take_runs(merger_t* pMerger, merger_t* pFrom)
+{
+	for (int i = 0; i < pFrom->nRuns; i++)
+	{
+		run_t* pRun = &pFrom->pRuns[i];
+		merger_add_run(pMerger, pRun->pData, pRun->pEnd - pRun->pData);
+	}
+	free(pFrom->pRuns);
+	free(pFrom->pHeap);
+	init_merger(pFrom);
+}
+
+/*
+ * @fn char* merger_get_next_key(merger_t* pMerger, char* pKey)
+ * @brief Gets the key following pKey across all runs, skipping the
+ *        values of pKey that were not taken
+ * @param merger_t* pMerger [in,out] The merger to iterate
+ * @param char*     pKey    [in]     The last key returned, or NULL to get
+ *                                   the first key
+ * @returns The next key in sorted order, or NULL once all are merged
+ */
+char* merger_get_next_key(merger_t* pMerger, char* pKey)
+{
+	if (!pMerger->bStarted)
+	{
+		pMerger->pHeap = Malloc((pMerger->nRuns + 1) * sizeof(int));
+		for (int i = 0; i < pMerger->nRuns; i++)
+		{
+			pMerger->pHeap[i] = i;
+		}
+		pMerger->nHeap = pMerger->nRuns;
+		for (int i = pMerger->nHeap / 2 - 1; i >= 0; i--)
+		{
+			merger_sift_down(pMerger, i);
+		}
+		pMerger->bStarted = 1;
+	}
+
+	while (pKey != NULL && merger_get_next_value(pMerger, pKey) != NULL)
+	{
+	}
+
+	if (pMerger->nHeap == 0)
+	{
+		return NULL;
+	}
+	return pMerger->pRuns[pMerger->pHeap[0]].pNext;
+}
+
+/*
+ * @fn char* merger_get_next_value(merger_t* pMerger, char* pKey)
+ * @brief Gets the next value of pKey, the key last returned by
+ *        merger_get_next_key
+ * @param merger_t* pMerger [in,out] The merger to iterate
+ * @param char*     pKey    [in]     The key to get values of
+ * @returns The next value, or NULL once all have been returned
+ */
+char* merger_get_next_value(merger_t* pMerger, char* pKey)
+{
+	char* pNext;
+
+	if (pMerger->nHeap == 0)
+	{
+		return NULL;
+	}
+	pNext = pMerger->pRuns[pMerger->pHeap[0]].pNext;
+	if (strcmp(pNext, pKey) != 0)
+	{
+		return NULL;
+	}
+	merger_advance(pMerger);
+
+	return pNext + strlen(pNext) + 1;
+}
+
+/*
+ * @fn void merger_advance(merger_t* pMerger)
+ * @brief Moves the run with the least key past its next pair, dropping it
+ *        from the heap once it has none left
+ * @param merger_t* pMerger [in,out] The merger to advance
+ */
+void merger_advance(merger_t* pMerger)
+{
+	run_t* pRun = &pMerger->pRuns[pMerger->pHeap[0]];
+
+	pRun->pNext += strlen(pRun->pNext) + 1;
+	pRun->pNext += strlen(pRun->pNext) + 1;
+	if (pRun->pNext >= pRun->pEnd)
+	{
+		pMerger->pHeap[0] = pMerger->pHeap[--pMerger->nHeap];
+	}
+	merger_sift_down(pMerger, 0);
+}
+
+/*
+ * @fn void merger_sift_down(merger_t* pMerger, int i)
+ * @brief Restores the heap order below heap slot i
+ * @param merger_t* pMerger [in,out] The merger
+ * @param int       i       [in]     The heap slot that may be out of order
+ */
+void merger_sift_down(merger_t* pMerger, int i)
+{
+	int* pHeap = pMerger->pHeap;
+	int least;
+	int swap;
+
+	while ((least = 2 * i + 1) < pMerger->nHeap)
+	{
+		if (least + 1 < pMerger->nHeap
+			&& merger_less(pMerger, pHeap[least + 1], pHeap[least]))
+		{
+			least++;
+		}
+		if (!merger_less(pMerger, pHeap[least], pHeap[i]))
+		{
+			break;
+		}
+		swap = pHeap[i];
+		pHeap[i] = pHeap[least];
+		pHeap[least] = swap;
+		i = least;
+	}
+}
+
+/*
+ * @fn int merger_less(merger_t* pMerger, int i, int j)
+ * @brief Compares the next keys of two runs
+ * @returns Nonzero if the next key of run i sorts before that of run j
+ */
+int merger_less(merger_t* pMerger, int i, int j)
+{
+	return strcmp(pMerger->pRuns[i].pNext, pMerger->pRuns[j].pNext) < 0;
+}
+
+/*
+ * @fn void destroy_merger(merger_t* pMerger)
+ * @brief Frees a merger's runs. Keys and values it returned are freed too.
+ * @param merger_t* pMerger [in,out] The merger to destroy
+ */
+void destroy_merger(merger_t* pMerger)
+{
+	for (int i = 0; i < pMerger->nRuns; i++)
+	{
+		free(pMerger->pRuns[i].pData);
+	}
+	free(pMerger->pRuns);
+	free(pMerger->pHeap);
+	init_merger(pMerger);
+}
+
+/*
+ * @fn void sort_pairs(char** pPairs, int nPairs, int depth)
+ * @brief Multikey quicksort of packed pairs by key: partitions on the
+ *        character at depth into less, equal and greater, and only moves
+ *        to the next character within the equal part, so common prefixes
+ *        are compared once rather than once per comparison
+ * @param char** pPairs [in,out] Pointers to packed pairs to sort
+ * @param int    nPairs [in]     The number of pairs
+ * @param int    depth  [in]     Characters of key all pairs share.
+ *                               Pass 0.
+ */
+void sort_pairs(char** pPairs, int nPairs, int depth)
+{
+	unsigned char pivot;
+	unsigned char c;
+	char* swap;
+	int lt;
+	int gt;
+
+	while (nPairs >= nInsertionSort)
+	{
+		swap = pPairs[0];
+		pPairs[0] = pPairs[nPairs / 2];
+		pPairs[nPairs / 2] = swap;
+		pivot = pPairs[0][depth];
+
+		lt = 0;
+		gt = nPairs - 1;
+		for (int i = 1; i <= gt; )
+		{
+			c = pPairs[i][depth];
+			if (c < pivot)
+			{
+				swap = pPairs[lt];
+				pPairs[lt++] = pPairs[i];
+				pPairs[i++] = swap;
+			}
+			else if (c > pivot)
+			{
+				swap = pPairs[gt];
+				pPairs[gt--] = pPairs[i];
+				pPairs[i] = swap;
+			}
+			else
+			{
+				i++;
+			}
+		}
+
+		sort_pairs(pPairs, lt, depth);
+		sort_pairs(pPairs + gt + 1, nPairs - gt - 1, depth);
+		if (pivot == '\0')
+		{
+			return;
+		}
+		pPairs += lt;
+		nPairs = gt - lt + 1;
+		depth++;
+	}
+
+	for (int i = 1; i < nPairs; i++)
+	{
+		for (int j = i; j > 0
+			&& strcmp(pPairs[j - 1] + depth, pPairs[j] + depth) > 0; j--)
+		{
+			swap = pPairs[j];
+			pPairs[j] = pPairs[j - 1];
+			pPairs[j - 1] = swap;
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef __merger_h__
+#define __merger_h__
+
+#include <stddef.h>
+
+/* key-value pairs sorted by key, packed as key\0value\0 */
+typedef struct __run_t
+{
+	char* pData;
+	/* the next unmerged pair, and the end of the run */
+	char* pNext;
+	char* pEnd;
+} run_t;
+
+typedef struct __merger_t
+{
+	/* sorted runs, freed with the merger */
+	run_t* pRuns;
+	int nRuns;
+	int nCapacity;
+	/* min-heap of the indexes of runs with pairs left, by next key */
+	int* pHeap;
+	int nHeap;
+	/* set once the heap has been built */
+	int bStarted;
+} merger_t;
+
+void init_merger(merger_t* pMerger);
+void merger_add_run(merger_t* pMerger, char* pData, size_t szData);
+void merger_take_runs(merger_t* pMerger, merger_t* pFrom);
+char* merger_get_next_key(merger_t* pMerger, char* pKey);
+char* merger_get_next_value(merger_t* pMerger, char* pKey);
+void merger_advance(merger_t* pMerger);
+void merger_sift_down(merger_t* pMerger, int i);
+int merger_less(merger_t* pMerger, int i, int j);
+void destroy_merger(merger_t* pMerger);
+void sort_pairs(char** pPairs, int nPairs, int depth);
+
+#endif // __merger_h__
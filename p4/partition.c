@@ -6,9 +6,11 @@ void init_partition(partition_t* pPartition)
 {
 	PthreadMutexInit(&pPartition->lock);
 	init_treemap(&pPartition->treemap);
+	init_merger(&pPartition->merger);
 }
 
 void destroy_partition(partition_t* pPartition)
 {
 	destroy_treemap(&pPartition->treemap);
+	destroy_merger(&pPartition->merger);
 }
@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include "merger.h"
 #include "treemap.h"
 
 typedef struct __partition_t
@@ -11,6 +12,8 @@ typedef struct __partition_t
 	pthread_mutex_t lock;
 	/* treemap for partitoon */
 	treemap_t treemap;
+	/* sorted runs from mappers, for the sort shuffle */
+	merger_t merger;
 } partition_t;
 
 void init_partition(partition_t* pPartition);
@@ -3,19 +3,32 @@
 # NOTE: THESE TESTS MUST BE PERFORMED WITH num_reducers SET TO 1 IN main.c 
 # OTHERWISE, NON-DETERMINISM FROM MULTITHREADING WILL CAUSE THEM TO FAIL.
 
+# Each test runs under every shuffle, with and without the combiner.
+# A test directory may hold a split-size file giving the bytes per split.
+modes="sort,1 sort,0 tree,1 tree,0"
+
 t() {
-  ./client-wordcount tests/$1/in/*.txt > tests/$1/$1-out-actual.txt
   expected="tests/$1/$1-out-expected.txt"
   actual="tests/$1/$1-out-actual.txt"
-
-  if cmp -s "$expected" "$actual"; then
-      echo "Test $i PASS"
-  else
-      echo "TEST $i FAIL"
+  split_size=$((1 << 20))
+  if [[ -f tests/$1/split-size ]]; then
+      split_size=$(cat tests/$1/split-size)
   fi
+
+  for mode in $modes
+  do
+      WORDCOUNT_SHUFFLE=${mode%,*} WORDCOUNT_COMBINE=${mode#*,} \
+      WORDCOUNT_SPLIT_SIZE=$split_size \
+          ./client-wordcount tests/$1/in/*.txt > "$actual"
+      if ! cmp -s "$expected" "$actual"; then
+          echo "TEST $i FAIL (shuffle ${mode%,*}, combine ${mode#*,})"
+          return
+      fi
+  done
+  echo "Test $i PASS"
 }
 
-max=8
+max=12
 for (( i=1; i <= $max; i++))
 do
 	t $i
@@ -50,7 +50,7 @@ void map(treemap_t* pTreeMap, char* filename)
 		{
 			if (strlen(token) > 0)
 			{
-				treemap_add(pTreeMap, CopyString(token), CopyString("1"));
+				treemap_add(pTreeMap, token, "1");
 			}
 		}
 	}
@@ -1,8 +1,8 @@
 #include <stdio.h>
 #include <string.h>
+#include "arena.h"
 #include "treenode.h"
 #include "treemap.h"
-#include "utilities.h"
 
 /*
  * @fn treemap_t* init_treemap()
@@ -12,36 +12,44 @@
 void init_treemap(treemap_t* pTreeMap)
 {
 	pTreeMap->root = NULL;
+	init_arena(&pTreeMap->arena);
 }
 
 /*
  * @fn void treemap_add(treemap_t* pTreeMap, char* pKey, char* pValue)
- * @brief Adds value to list on the node with the given key
+ * @brief Adds value to list on the node with the given key. A key is
+ *        copied once, with its node; values are interned, so equal values
+ *        may share one copy and must not be modified.
  * @param treemap_t* pTreeMap [in,out] The map to add key value pair
  * @param char*      pKey     [in]     The key to add value to
  * @param char*      pValue   [in]     The value to add to list
  */
 void treemap_add(treemap_t* pTreeMap, char* pKey, char* pValue)
 {
-	pTreeMap->root = r_treemap_add(pTreeMap->root, pKey, pValue);
+	pTreeMap->root = r_treemap_add(&pTreeMap->arena, pTreeMap->root, 
+									pKey, pValue);
 	set_color(pTreeMap->root, Black);
 }
 
 /*
- * @fn tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char* pValue)
+ * @fn tree_node_t* r_treemap_add(arena_t* pArena, tree_node_t* pNode, 
+ *                                char* pKey, char* pValue)
  * @brief Add key value pair to descendent of the given node. 
  *        Creates node for the key if one doesn't exists and adds it to tree.
  *        Adds the value to list of values associated with the key.
- * @param tree_node_t* pNode  [in] The node to search for key in descendents
- * @param char*        pKey   [in] The key to add
- * @param char*        pValue [in] The value to add
+ * @param arena_t*     pArena [in,out] The arena holding the tree
+ * @param tree_node_t* pNode  [in]     The node to search for key in 
+ *                                     descendents
+ * @param char*        pKey   [in]     The key to add
+ * @param char*        pValue [in]     The value to add
  * @returns Pointer to the node which was passed in.
  */
-tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char* pValue)
+tree_node_t* r_treemap_add(arena_t* pArena, tree_node_t* pNode, char* pKey, 
+							char* pValue)
 {
 	if (pNode == NULL)
 	{
-		return init_tree_node(pKey, pValue);
+		return init_tree_node(pArena, pKey, pValue);
 	}
 
 	int compare;
@@ -52,7 +60,7 @@ tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char* pValue)
 	if (compare == 0)
 	{
 		//found!
-		add_value(pNode, pValue);
+		add_value(pArena, pNode, pValue);
 		return pNode;
 	}
 
@@ -68,7 +76,7 @@ tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char* pValue)
 
 	if (compare < 0)
 	{
-		pLeft = r_treemap_add(pLeft, pKey, pValue);
+		pLeft = r_treemap_add(pArena, pLeft, pKey, pValue);
 		set_left(pNode, pLeft);
 
 		if (get_color(pLeft) == Red)
@@ -91,7 +99,7 @@ tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char* pValue)
 	}
 	else if (compare > 0)
 	{
-		pRight = r_treemap_add(pRight, pKey, pValue);
+		pRight = r_treemap_add(pArena, pRight, pKey, pValue);
 		set_right(pNode, pRight);
 
 		if (get_color(pRight) == Red)
@@ -259,12 +267,13 @@ char* r_treemap_get_next_value(tree_node_t* pTreeNode, char* pKey)
 
 /*
  * @fn void destroy_treemap(treemap_t* pTreeMap)
- * @brief destroy all nodes in tree
+ * @brief destroy all nodes in tree, freeing the arena they were allocated
+ *        from rather than each node
  * @param treemap_t* pTreeMap [in,out] treemap to destroy
  */
 void destroy_treemap(treemap_t* pTreeMap)
 {
-	destroy_tree_node(pTreeMap->root);
+	destroy_arena(&pTreeMap->arena);
 	pTreeMap->root = NULL;
 }
 
@@ -1,6 +1,7 @@
 #ifndef __treemap_h__
 #define __treemap_h__
 
+#include "arena.h"
 #include "list.h"
 #include "treenode.h"
 
@@ -10,11 +11,14 @@ typedef struct __treemap_t
 	tree_node_t* root;
 	/* cursor position of the current key for iterating keys in the tree */
 	char* cursor;
+	/* holds the nodes, keys and values of the tree */
+	arena_t arena;
 } treemap_t;
 
 void init_treemap(treemap_t* pTreeMap);
 void treemap_add(treemap_t* pTreeMap, char* pKey, char* pValue);
-tree_node_t* r_treemap_add(tree_node_t* pNode, char* pKey, char*pValue);
+tree_node_t* r_treemap_add(arena_t* pArena, tree_node_t* pNode, char* pKey, 
+	char* pValue);
 tree_node_t* rotate_left(tree_node_t* pTreeNode);
 tree_node_t* rotate_right(tree_node_t* pTreeNode);
 char* treemap_get_next_key(treemap_t* pTreeMap, char* pKey);
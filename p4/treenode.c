@@ -1,22 +1,23 @@
 #include <stdio.h>
+#include "arena.h"
 #include "list.h"
 #include "treenode.h"
-#include "utilities.h"
 
 /*
- * @fn tree_node_t* init_tree_node(char* pKey, char* pValue)
- * @brief Allocate a new tree node containing pointers to the specified data.
- * @param char* pKey   [in] The key stored in this node
- * @param char* pValue [in] The value to store
+ * @fn tree_node_t* init_tree_node(arena_t* pArena, char* pKey, char* pValue)
+ * @brief Allocate a new tree node containing copies of the specified data.
+ * @param arena_t* pArena [in,out] The arena to allocate the node and data
+ * @param char*    pKey   [in]     The key stored in this node
+ * @param char*    pValue [in]     The value to store
  * @returns The allocated tree node
  */
-tree_node_t* init_tree_node(char* pKey, char* pValue)
+tree_node_t* init_tree_node(arena_t* pArena, char* pKey, char* pValue)
 {
 	tree_node_t* pTreeNode;
-	pTreeNode = Malloc(sizeof(tree_node_t));
-	pTreeNode->key = CopyString(pKey);
-	pTreeNode->values = init_list();
-	pTreeNode->values = list_add(pTreeNode->values, pValue);
+	pTreeNode = arena_alloc(pArena, sizeof(tree_node_t));
+	pTreeNode->key = arena_copy_string(pArena, pKey);
+	pTreeNode->values = init_list(pArena);
+	pTreeNode->values = list_add(pArena, pTreeNode->values, pValue);
 	pTreeNode->left = NULL;
 	pTreeNode->right = NULL;
 	pTreeNode->color = Red;
@@ -105,33 +106,15 @@ void set_color(tree_node_t* pTreeNode, enum Color color)
 }
 
 /*
- * @fn void add_value(tree_node_t* pTreeNode, char* pValue)
+ * @fn void add_value(arena_t* pArena, tree_node_t* pTreeNode, char* pValue)
  * @brief adds the value to this node's value list
+ * @param arena_t*     pArena    [in,out] The arena holding the node
  * @param tree_node_t* pTreeNode [in,out] The node to add value to
  * @param char*        pValue    [in]     The value to add to this node's list
  */
-void add_value(tree_node_t* pTreeNode, char* pValue)
+void add_value(arena_t* pArena, tree_node_t* pTreeNode, char* pValue)
 {
-	list_add(pTreeNode->values, pValue);
-}
-
-/*
- * @fn void destroy_tree_node(tree_node_t* pTreeNode)
- * @brief Frees the current node and all chidren recursively
- * @param tree_node_t* pTreeNode [in,out] The node to free
- */
-void destroy_tree_node(tree_node_t* pTreeNode)
-{
-	if (pTreeNode == NULL)
-	{
-		return;
-	}
-	
-	destroy_list(pTreeNode->values);
-	destroy_tree_node(pTreeNode->left);
-	destroy_tree_node(pTreeNode->right);
-	free(pTreeNode->key);
-	free(pTreeNode);
+	list_add(pArena, pTreeNode->values, pValue);
 }
 
 /*
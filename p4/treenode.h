@@ -1,6 +1,7 @@
 #ifndef __treenode_h__
 #define __treenode_h__
 
+#include "arena.h"
 #include "list.h"
 
 enum Color { Red, Black, None };
@@ -20,7 +21,7 @@ struct __tree_node_t
 	enum Color color;
 };
 
-tree_node_t* init_tree_node(char* pKey, char* pValue);
+tree_node_t* init_tree_node(arena_t* pArena, char* pKey, char* pValue);
 char* get_key(tree_node_t* pTreeNode);
 tree_node_t* get_left(tree_node_t* pTreeNode);
 tree_node_t* get_right(tree_node_t* pTreeNode);
@@ -28,8 +29,7 @@ enum Color get_color(tree_node_t* pTreeNode);
 void set_left(tree_node_t* pTreeNode, tree_node_t* pChild);
 void set_right(tree_node_t* pTreeNode, tree_node_t* pChild);
 void set_color(tree_node_t* pTreeNode, enum Color color);
-void add_value(tree_node_t* pTreeNode, char* pValue);
-void destroy_tree_node(tree_node_t* pTreeNode);
+void add_value(arena_t* pArena, tree_node_t* pTreeNode, char* pValue);
 void print_tree_node(tree_node_t* pTreeNode);
 
 #endif // __treenode_h__